@@ -11,16 +11,57 @@ double logSumExp(const arma::vec& invec)
   return offset + log(res);
 }
 
+Adjacency::Adjacency(arma::uword n, const arma::uvec& from, const arma::uvec& to)
+  : ptr(n + 1, arma::fill::zeros)
+{
+  for(arma::uword e = 0; e < from.n_elem; ++e){
+    if(from[e] != to[e]){
+      ptr[from[e] + 1]++;
+    }
+  }
+  for(arma::uword i = 0; i < n; ++i){
+    ptr[i + 1] += ptr[i];
+  }
+  ind.set_size(ptr[n]);
+  arma::uvec next_pos(ptr.begin(), n);
+  for(arma::uword e = 0; e < from.n_elem; ++e){
+    if(from[e] != to[e]){
+      ind[next_pos[from[e]]++] = to[e];
+    }
+  }
+  // Sort and compact each row
+  arma::uword k = 0, start, end;
+  for(arma::uword i = 0; i < n; ++i){
+    start = ptr[i];
+    end = ptr[i + 1];
+    std::sort(ind.begin() + start, ind.begin() + end);
+    ptr[i] = k;
+    for(arma::uword j = start; j < end; ++j){
+      if((k == ptr[i]) || (ind[j] != ind[k - 1])){
+        ind[k++] = ind[j];
+      }
+    }
+  }
+  ptr[n] = k;
+  ind.resize(k);
+}
+
 /*
  // Adaptation of vmmin in optim.c to
- // enable use in threaded call
+ // enable use in threaded call. If fminfg
+ // is not NULL, it gives value and gradient
+ // in one pass at the initial point and at the
+ // first (full) step of each line search, which
+ // is accepted in most iterations. Shorter
+ // trial steps only evaluate fminfn, and their
+ // gradient is computed once a point is accepted.
  */
-void vmmin_ours(int n0, double *b, double *Fmin, optimfn fminfn, optimgr fmingr,
+void vmmin_ours(int n0, double *b, double *Fmin, optimfn fminfn, optimgr fmingr, optimfg fminfg,
                 int maxit, int trace, int *mask,
                 double abstol, double reltol, int nREPORT, void *ex,
                 int *fncount, int *grcount, int *fail)
 {
-  bool accpoint, enough;
+  bool accpoint, enough, have_gr = FALSE;
   int   count, funcount, gradcount;
   double f, gradproj;
   int   i, j, ilast, iter = 0;
@@ -38,19 +79,19 @@ void vmmin_ours(int n0, double *b, double *Fmin, optimfn fminfn, optimgr fmingr,
   std::vector<int> l(n0, 1);
   n = 0;
   for (i = 0; i < n0; i++) if (mask[i]) l[n++] = i;
-  std::vector<double> g(n0, 0.0);
+  std::vector<double> g(n0, 0.0), g_trial(fminfg ? n0 : 0, 0.0);
   std::vector<double> t(n, 0.0);
   std::vector<double> X(n, 0.0);
   std::vector<double> c(n, 0.0);
   std::vector< std::vector<double> > B(n, std::vector<double>(n));
-  f = fminfn(n0, b, ex);
+  f = fminfg ? fminfg(n0, b, &g[0], ex) : fminfn(n0, b, ex);
   if (!R_FINITE(f)){
     *fail = 1;
     return;
   }
   *Fmin = f;
   funcount = gradcount = 1;
-  fmingr(n0, b, &g[0], ex);
+  if (!fminfg) fmingr(n0, b, &g[0], ex);
   iter++;
   ilast = gradcount;
   do {
@@ -85,7 +126,8 @@ steplength = 1.0;
 count++;
         }
         if (count < n) {
-          f = fminfn(n0, b, ex);
+          have_gr = fminfg && (steplength == 1.0);
+          f = have_gr ? fminfg(n0, b, &g_trial[0], ex) : fminfn(n0, b, ex);
           funcount++;
           accpoint = R_FINITE(f) &&
             (f <= *Fmin + gradproj * steplength * 0.0001);
@@ -103,7 +145,8 @@ count++;
       }
       if (count < n) {/* making progress */
       *Fmin = f;
-        fmingr(n0, b, &g[0], ex);
+        if (have_gr) std::copy(g_trial.begin(), g_trial.end(), g.begin());
+        else fmingr(n0, b, &g[0], ex);
         gradcount++;
         iter++;
         D1 = 0.0;
@@ -152,3 +195,153 @@ count++;
   *fncount = funcount;
   *grcount = gradcount;
 }
+
+/*
+ // Limited-memory variant of vmmin_ours. The
+ // inverse Hessian is represented by the last
+ // m correction pairs (two-loop recursion),
+ // so memory is O(m * n) rather than O(n^2).
+ // Masking, line search and stopping rules are
+ // those of vmmin_ours.
+ */
+void lbfgs_ours(int n0, double *b, double *Fmin, optimfn fminfn, optimgr fmingr, optimfg fminfg,
+                int maxit, int trace, int *mask,
+                double abstol, double reltol, int nREPORT, void *ex,
+                int *fncount, int *grcount, int *fail, int m)
+{
+  bool accpoint, enough, have_gr = FALSE;
+  int   count, funcount, gradcount;
+  double f, gradproj;
+  int   i, k, idx, iter = 0;
+  int   n_hist = 0, head = 0;
+  double s, steplength, scale;
+  double D1;
+  int   n;
+  
+  if (maxit <= 0) {
+    *fail = 0;
+    *Fmin = fminfn(n0, b, ex);
+    *fncount = *grcount = 0;
+    return;
+  }
+  if (m < 1) m = 1;
+  
+  std::vector<int> l(n0, 1);
+  n = 0;
+  for (i = 0; i < n0; i++) if (mask[i]) l[n++] = i;
+  std::vector<double> g(n0, 0.0), g_trial(fminfg ? n0 : 0, 0.0);
+  std::vector<double> t(n, 0.0);
+  std::vector<double> X(n, 0.0);
+  std::vector<double> c(n, 0.0);
+  std::vector<double> S(m * n, 0.0);
+  std::vector<double> Y(m * n, 0.0);
+  std::vector<double> rho(m, 0.0);
+  std::vector<double> a(m, 0.0);
+  f = fminfg ? fminfg(n0, b, &g[0], ex) : fminfn(n0, b, ex);
+  if (!R_FINITE(f)){
+    *fail = 1;
+    return;
+  }
+  *Fmin = f;
+  funcount = gradcount = 1;
+  if (!fminfg) fmingr(n0, b, &g[0], ex);
+  iter++;
+  do {
+    Rcpp::checkUserInterrupt();
+    for (i = 0; i < n; i++) {
+      X[i] = b[l[i]];
+      c[i] = g[l[i]];
+      t[i] = -c[i];
+    }
+    /* two-loop recursion, newest pair first */
+    for (k = 0; k < n_hist; k++) {
+      idx = (head - 1 - k + m) % m;
+      s = 0.0;
+      for (i = 0; i < n; i++) s += S[idx * n + i] * t[i];
+      a[idx] = rho[idx] * s;
+      for (i = 0; i < n; i++) t[i] -= a[idx] * Y[idx * n + i];
+    }
+    if (n_hist > 0) {
+      idx = (head - 1 + m) % m;
+      s = 0.0;
+      for (i = 0; i < n; i++) s += Y[idx * n + i] * Y[idx * n + i];
+      scale = 1.0 / (rho[idx] * s);
+      for (i = 0; i < n; i++) t[i] *= scale;
+    }
+    for (k = n_hist - 1; k >= 0; k--) {
+      idx = (head - 1 - k + m) % m;
+      s = 0.0;
+      for (i = 0; i < n; i++) s += Y[idx * n + i] * t[i];
+      s = a[idx] - rho[idx] * s;
+      for (i = 0; i < n; i++) t[i] += s * S[idx * n + i];
+    }
+    gradproj = 0.0;
+    for (i = 0; i < n; i++) gradproj += t[i] * c[i];
+    
+    if (gradproj < 0.0) {	/* search direction is downhill */
+      steplength = 1.0;
+      accpoint = FALSE;
+      do {
+        count = 0;
+        for (i = 0; i < n; i++) {
+          b[l[i]] = X[i] + steplength * t[i];
+          if (10.0 + X[i] == 10.0 + b[l[i]]) /* no change */
+            count++;
+        }
+        if (count < n) {
+          have_gr = fminfg && (steplength == 1.0);
+          f = have_gr ? fminfg(n0, b, &g_trial[0], ex) : fminfn(n0, b, ex);
+          funcount++;
+          accpoint = R_FINITE(f) &&
+            (f <= *Fmin + gradproj * steplength * 0.0001);
+          if (!accpoint) {
+            steplength *= 0.2;
+          }
+        }
+      } while (!(count == n || accpoint));
+      enough = (f > abstol) &&
+        fabs(f - *Fmin) > reltol * (fabs(*Fmin) + reltol);
+      /* stop if value if small or if relative change is low */
+      if (!enough) {
+        count = n;
+        *Fmin = f;
+      }
+      if (count < n) {/* making progress */
+        *Fmin = f;
+        if (have_gr) std::copy(g_trial.begin(), g_trial.end(), g.begin());
+        else fmingr(n0, b, &g[0], ex);
+        gradcount++;
+        iter++;
+        D1 = 0.0;
+        for (i = 0; i < n; i++) {
+          t[i] = steplength * t[i];
+          c[i] = g[l[i]] - c[i];
+          D1 += t[i] * c[i];
+        }
+        if (D1 > 0) {
+          std::copy(t.begin(), t.end(), S.begin() + head * n);
+          std::copy(c.begin(), c.end(), Y.begin() + head * n);
+          rho[head] = 1.0 / D1;
+          head = (head + 1) % m;
+          if (n_hist < m) n_hist++;
+        } else {	/* D1 < 0 */
+          n_hist = 0;
+        }
+      } else {	/* no progress */
+        if (n_hist > 0) {
+          count = 0;
+          n_hist = 0;
+        }
+      }
+    } else {		/* uphill search */
+      count = 0;
+      if (n_hist == 0) count = n;
+      else n_hist = 0;
+      /* Resets unless has just been reset */
+    }
+    if (iter >= maxit) break;
+  } while (count != n || n_hist != 0);
+  *fail = (iter < maxit) ? 0 : 1;
+  *fncount = funcount;
+  *grcount = gradcount;
+}
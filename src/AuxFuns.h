@@ -5,20 +5,83 @@
 #include <initializer_list>
 #include <functional>
 #include <numeric>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <RcppArmadillo.h>
 
 
 
 double logSumExp(const arma::vec& invec);
 
+// log(1 + exp(x)), without overflow for large x
+inline double log1pExp(double x)
+{
+  return x > 0.0 ? x + log1p(exp(-x)) : log1p(exp(x));
+}
+
+// Wall time (in seconds) since start
+inline double elapsed(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compressed sparse row adjacency: neighbours of node i are
+// ind[ptr[i]], ..., ind[ptr[i + 1] - 1], sorted and without
+// duplicates or self-loops.
+struct Adjacency
+{
+  arma::uvec ptr, ind;
+
+  Adjacency(arma::uword n, const arma::uvec& from, const arma::uvec& to);
+
+  arma::uword size(arma::uword i) const
+  {
+    return ptr[i + 1] - ptr[i];
+  }
+
+  bool has(arma::uword i, arma::uword j) const
+  {
+    return std::binary_search(ind.begin() + ptr[i], ind.begin() + ptr[i + 1], j);
+  }
+};
+
+// Raw binary I/O of contiguous blocks (used in checkpoints).
+// The element count and size are stored ahead of the data and
+// checked on read.
+template<typename T>
+void writeBlock(std::ostream& out, const T* data, arma::uword n_elem)
+{
+  unsigned long long n = n_elem, elem_size = sizeof(T);
+  out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  out.write(reinterpret_cast<const char*>(&elem_size), sizeof(elem_size));
+  out.write(reinterpret_cast<const char*>(data), n_elem * sizeof(T));
+}
+template<typename T>
+void readBlock(std::istream& in, T* data, arma::uword n_elem)
+{
+  unsigned long long n = 0, elem_size = 0;
+  in.read(reinterpret_cast<char*>(&n), sizeof(n));
+  in.read(reinterpret_cast<char*>(&elem_size), sizeof(elem_size));
+  if(!in || n != n_elem || elem_size != sizeof(T)){
+    Rcpp::stop("Checkpoint does not match current model.");
+  }
+  in.read(reinterpret_cast<char*>(data), n_elem * sizeof(T));
+  if(!in){
+    Rcpp::stop("Checkpoint file is truncated.");
+  }
+}
+
 typedef double optimfn(int, double*, void*);
 typedef void optimgr(int, double*, double*, void*);
+typedef double optimfg(int, double*, double*, void*);
 
 void vmmin_ours(int,
 		double*,
 		double*,
 		optimfn,
 		optimgr,
+		optimfg,
 		int,
 		int,
 		int*,
@@ -30,4 +93,22 @@ void vmmin_ours(int,
 		int*,
 		int*);
 
+void lbfgs_ours(int,
+		double*,
+		double*,
+		optimfn,
+		optimgr,
+		optimfg,
+		int,
+		int,
+		int*,
+		double,
+		double,
+		int,
+		void*,
+		int*,
+		int*,
+		int*,
+		int);
+
 #endif // AUX_HPP
@@ -1,37 +1,62 @@
+#include <random>
 #include <RcppArmadillo.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 //' @rdname auxfuns
 // [[Rcpp::export()]]
 Rcpp::NumericMatrix approxB(Rcpp::NumericVector y,
                             Rcpp::IntegerMatrix d_id,
                             Rcpp::NumericMatrix pi_mat, 
-                            bool directed = true)
+                            bool directed = true,
+                            int threads = 1)
 {
-  int N_BLK = pi_mat.nrow();
-  int N_DYAD = d_id.nrow();
-  Rcpp::NumericMatrix den(N_BLK, N_BLK), num(N_BLK, N_BLK), B_t(N_BLK, N_BLK);
-  int s, r;
-  double prob_temp;
-  for(int d = 0; d < N_DYAD; ++d){
-    s = d_id(d, 0);
-    r = d_id(d, 1);
-    for(int g = 0; g < N_BLK; ++g){
-      for(int h = 0; h < N_BLK; ++h){
-        if((g <= h) | directed){
-          prob_temp = pi_mat(g, s) * pi_mat(h, r);
-          num(h, g) += y[d] * prob_temp;
-          den(h, g) += prob_temp;
-        } else{
-          num(h, g) = num(g, h);
-          den(h, g) = den(g, h);
-        }
-      }
+  const arma::uword N_BLK = pi_mat.nrow(), N_NODE = pi_mat.ncol(),
+    N_DYAD = d_id.nrow(), CHUNK = 1024,
+    N_CHUNK = (N_DYAD + CHUNK - 1) / CHUNK,
+    N_THREAD = threads > 1 ? threads : 1;
+  const arma::mat pi_a(pi_mat.begin(), N_BLK, N_NODE, false, true);
+  const int *send_id = d_id.begin(), *rec_id = d_id.begin() + N_DYAD;
+  const double *y_val = y.begin();
+  
+  // Numerator and denominator are sums of pi_r * pi_s' over
+  // dyads (weighted by y in the numerator). Each thread
+  // accumulates chunks of dyads with a matrix product.
+  arma::cube num(N_BLK, N_BLK, N_THREAD, arma::fill::zeros),
+    den(N_BLK, N_BLK, N_THREAD, arma::fill::zeros);
+#pragma omp parallel num_threads(N_THREAD) if(N_THREAD > 1)
+{
+  int thread = 0;
+#ifdef _OPENMP
+  thread = omp_get_thread_num();
+#endif
+  arma::mat pi_s(N_BLK, CHUNK), pi_r(N_BLK, CHUNK);
+#pragma omp for schedule(static)
+  for(arma::uword c = 0; c < N_CHUNK; ++c){
+    arma::uword first = c * CHUNK, n_d = std::min(CHUNK, N_DYAD - first);
+    for(arma::uword i = 0; i < n_d; ++i){
+      pi_s.col(i) = pi_a.col(send_id[first + i]);
+      pi_r.col(i) = pi_a.col(rec_id[first + i]);
+    }
+    den.slice(thread) += pi_r.head_cols(n_d) * pi_s.head_cols(n_d).t();
+    for(arma::uword i = 0; i < n_d; ++i){
+      pi_r.col(i) *= y_val[first + i];
     }
+    num.slice(thread) += pi_r.head_cols(n_d) * pi_s.head_cols(n_d).t();
+  }
+}
+  for(arma::uword thread = 1; thread < N_THREAD; ++thread){
+    num.slice(0) += num.slice(thread);
+    den.slice(0) += den.slice(thread);
+  }
+  
+  Rcpp::NumericMatrix B_t(N_BLK, N_BLK);
+  arma::mat B_view(B_t.begin(), N_BLK, N_BLK, false, true);
+  B_view = num.slice(0) / den.slice(0);
+  if(!directed){
+    B_view = arma::symmatl(B_view);
   }
-  std::transform(num.begin(), num.end(),
-                 den.begin(),
-                 B_t.begin(),
-                 std::divides<double>());
   return B_t;
 }
 
@@ -154,5 +179,297 @@ arma::vec alphaGrad(arma::vec par,
   return(gr);
 }
 
+// Draw index from a discrete distribution with (unnormalized) weights
+template<typename RNG>
+arma::uword sampleDiscrete(const double* prob, arma::uword n, double total, RNG& rng)
+{
+  double u = std::uniform_real_distribution<double>(0.0, total)(rng), acc = prob[0];
+  arma::uword k = 0;
+  while((acc < u) && (k < n - 1)){
+    acc += prob[++k];
+  }
+  return k;
+}
+
+// Analytic Hessian of alphaLBound. Coefficients in different
+// HMM states do not interact, so only diagonal blocks are filled.
+arma::mat alphaHessInternal(const arma::vec& par,
+                            const arma::uvec& tot_nodes,
+                            const arma::umat& c_t,
+                            const arma::mat& x_t,
+                            const arma::umat& s_mat,
+                            const arma::uvec& t_id,
+                            const arma::cube& var_beta)
+{
+  const arma::uword N_NODE = x_t.n_cols, N_BLK = c_t.n_rows,
+    N_MONAD_PRED = x_t.n_rows,  N_STATE = s_mat.n_rows;
+  arma::mat hess(par.n_elem, par.n_elem, arma::fill::zeros);
+  arma::mat alpha(N_BLK, N_NODE), w_own(N_BLK, N_NODE);
+  arma::rowvec w_cross(N_NODE), w_gh(N_NODE);
+  double w, alpha_row, row_term, alpha_val;
+
+  for(arma::uword m = 0; m < N_STATE; ++m){
+    const arma::uword offset = N_MONAD_PRED * N_BLK * m;
+    alpha = arma::exp(arma::reshape(par.subvec(offset, offset + N_MONAD_PRED * N_BLK - 1),
+                                    N_MONAD_PRED, N_BLK).t() * x_t);
+    for(arma::uword p = 0; p < N_NODE; ++p){
+      w = s_mat(m, t_id[p]);
+      alpha_row = arma::accu(alpha.col(p));
+      row_term = R::digamma(alpha_row) - R::digamma(alpha_row + tot_nodes[p]);
+      w_cross[p] = w * (R::trigamma(alpha_row) - R::trigamma(alpha_row + tot_nodes[p]));
+      for(arma::uword g = 0; g < N_BLK; ++g){
+        alpha_val = alpha(g, p);
+        w_own(g, p) = w * alpha_val * (row_term + R::digamma(alpha_val + c_t(g, p)) - R::digamma(alpha_val)
+                                         + alpha_val * (R::trigamma(alpha_val + c_t(g, p)) - R::trigamma(alpha_val)));
+      }
+    }
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      for(arma::uword h = g; h < N_BLK; ++h){
+        w_gh = w_cross % alpha.row(g) % alpha.row(h);
+        if(g == h){
+          w_gh += w_own.row(g);
+        }
+        arma::mat blk = -(x_t.each_row() % w_gh) * x_t.t();
+        hess.submat(offset + N_MONAD_PRED * g, offset + N_MONAD_PRED * h,
+                    offset + N_MONAD_PRED * (g + 1) - 1, offset + N_MONAD_PRED * (h + 1) - 1) = blk;
+        hess.submat(offset + N_MONAD_PRED * h, offset + N_MONAD_PRED * g,
+                    offset + N_MONAD_PRED * (h + 1) - 1, offset + N_MONAD_PRED * (g + 1) - 1) = blk.t();
+      }
+      for(arma::uword x = 0; x < N_MONAD_PRED; ++x){
+        hess(offset + N_MONAD_PRED * g + x, offset + N_MONAD_PRED * g + x) += 1.0 / var_beta(x, g, m);
+      }
+    }
+  }
+  return(hess);
+}
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+arma::mat alphaHess(arma::vec par,
+                    arma::uvec tot_nodes,
+                    arma::umat c_t,
+                    arma::mat x_t,
+                    arma::umat s_mat,
+                    arma::uvec t_id,
+                    arma::cube var_beta,
+                    arma::cube mu_beta)
+{
+  return(alphaHessInternal(par, tot_nodes, c_t, x_t, s_mat, t_id, var_beta));
+}
+
+// Symmetric inverse of a Hessian, with the diagonal shifted
+// when needed so that the result is positive definite. May
+// emit Armadillo warnings, so not to be called from threads.
+bool vcovFromHess(const arma::mat& hess, arma::mat& vc)
+{
+  arma::vec ev;
+  if(!arma::inv(vc, hess)){
+    return false;
+  }
+  vc = arma::symmatu(vc);
+  if(!arma::eig_sym(ev, vc)){
+    return false;
+  }
+  double min_ev = ev.min();
+  if(min_ev < 0.0){
+    vc.diag() -= min_ev - 1e-4;
+  }
+  return true;
+}
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+arma::mat vcovBetaSim(const arma::vec& par,
+                      const arma::mat& send_phi,
+                      const arma::mat& rec_phi,
+                      const arma::umat& d_id,
+                      const arma::uvec& tot_nodes,
+                      const arma::mat& x_t,
+                      const arma::mat& kappa,
+                      const arma::uvec& t_id,
+                      const arma::cube& var_beta,
+                      int nsim,
+                      int threads = 1)
+{
+  const arma::uword N_BLK = send_phi.n_rows, N_NODE = x_t.n_cols,
+    N_DYAD = d_id.n_rows, N_STATE = kappa.n_rows, N_TIME = kappa.n_cols;
+
+  // Seeded from R's RNG, as in simulateNet
+  std::vector<std::uint32_t> seeds(nsim);
+  for(int n = 0; n < nsim; ++n){
+    seeds[n] = static_cast<std::uint32_t>(R::unif_rand() * 4294967295.0);
+  }
+  arma::cube hess_sim(par.n_elem, par.n_elem, nsim), vcov_sim(par.n_elem, par.n_elem, nsim);
+  arma::uvec empty_state(nsim, arma::fill::zeros), singular(nsim, arma::fill::zeros);
 
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1)
+  for(int n = 0; n < nsim; ++n){
+    std::mt19937 rng(seeds[n]);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
 
+    // Group counts are sums of independent Bernoulli
+    // draws over the dyads each node takes part in
+    arma::umat c_t(N_BLK, N_NODE, arma::fill::zeros);
+    for(arma::uword d = 0; d < N_DYAD; ++d){
+      for(arma::uword g = 0; g < N_BLK; ++g){
+        c_t(g, d_id(d, 0)) += unif(rng) < send_phi(g, d);
+        c_t(g, d_id(d, 1)) += unif(rng) < rec_phi(g, d);
+      }
+    }
+
+    arma::umat s_mat(N_STATE, N_TIME, arma::fill::zeros);
+    for(arma::uword t = 0; t < N_TIME; ++t){
+      s_mat(sampleDiscrete(kappa.colptr(t), N_STATE, arma::accu(kappa.col(t)), rng), t) = 1;
+    }
+    empty_state[n] = arma::any(arma::sum(s_mat, 1) == 0);
+
+    hess_sim.slice(n) = alphaHessInternal(par, tot_nodes, c_t, x_t, s_mat, t_id, var_beta);
+  }
+  // Inversions are serial: Armadillo reports failures
+  // through R, which must not be called from threads
+  for(int n = 0; n < nsim; ++n){
+    singular[n] = !vcovFromHess(hess_sim.slice(n), vcov_sim.slice(n));
+  }
+
+  if(arma::any(singular)){
+    Rcpp::stop("Hessian of monadic coefficients is singular.");
+  }
+  if(arma::any(empty_state)){
+    Rcpp::warning("Some HMM states are empty; no standard errors will be returned for coefficients associated with them.");
+  }
+  return(arma::mat(arma::mean(vcov_sim, 2).slice(0)));
+}
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+arma::mat vcovThetaSim(const arma::mat& send_phi,
+                       const arma::mat& rec_phi,
+                       const arma::mat& z_t,
+                       const arma::umat& par_ind,
+                       const arma::vec& theta,
+                       const arma::vec& lambda,
+                       const arma::umat& samp_ind,
+                       int threads = 1)
+{
+  const arma::uword N_BLK = send_phi.n_rows, N_DYAD = send_phi.n_cols,
+    N_B_PAR = theta.n_elem - z_t.n_rows, N_PAR = theta.n_elem,
+    N_SAMP = samp_ind.n_rows, N_SIM = samp_ind.n_cols;
+  if(lambda.n_elem != N_PAR){
+    Rcpp::stop("Prior variances do not match number of dyadic parameters.");
+  }
+  const arma::vec gamma = theta.tail(z_t.n_rows);
+  const double scale = double(N_DYAD) / N_SAMP;
+
+  // Seeded from R's RNG, as in simulateNet
+  std::vector<std::uint32_t> seeds(N_SIM);
+  for(arma::uword n = 0; n < N_SIM; ++n){
+    seeds[n] = static_cast<std::uint32_t>(R::unif_rand() * 4294967295.0);
+  }
+  arma::cube hess_sim(N_PAR, N_PAR, N_SIM), vcov_sim(N_PAR, N_PAR, N_SIM);
+  arma::uvec singular(N_SIM, arma::fill::zeros);
+
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1)
+  for(arma::uword n = 0; n < N_SIM; ++n){
+    std::mt19937 rng(seeds[n]);
+
+    // Weighted cross-product of the design (block indicators
+    // and dyadic predictors), accumulated one dyad at a time
+    arma::mat info(N_PAR, N_PAR, arma::fill::zeros);
+    arma::uword d, k;
+    double eta, w;
+    for(arma::uword i = 0; i < N_SAMP; ++i){
+      d = samp_ind(i, n);
+      k = par_ind(sampleDiscrete(send_phi.colptr(d), N_BLK, 1.0, rng),
+                  sampleDiscrete(rec_phi.colptr(d), N_BLK, 1.0, rng));
+      eta = theta[k] + arma::dot(gamma, z_t.col(d));
+      w = 1.0 / (2.0 + exp(eta) + exp(-eta));
+      info(k, k) += w;
+      for(arma::uword x = 0; x < z_t.n_rows; ++x){
+        info(k, N_B_PAR + x) += w * z_t(x, d);
+        for(arma::uword y = x; y < z_t.n_rows; ++y){
+          info(N_B_PAR + x, N_B_PAR + y) += w * z_t(x, d) * z_t(y, d);
+        }
+      }
+    }
+    info = arma::symmatu(info);
+    info.diag() -= 1.0 / lambda;
+    hess_sim.slice(n) = info * scale;
+  }
+  for(arma::uword n = 0; n < N_SIM; ++n){
+    singular[n] = !vcovFromHess(hess_sim.slice(n), vcov_sim.slice(n));
+  }
+
+  if(arma::any(singular)){
+    Rcpp::stop("Hessian of dyadic and blockmodel coefficients is singular.");
+  }
+  return(arma::mat(arma::mean(vcov_sim, 2).slice(0)));
+}
+
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+Rcpp::List simulateNet(const arma::cube& alpha,
+                       const arma::mat& kappa,
+                       const arma::uvec& t_id_node,
+                       const arma::umat& d_id,
+                       const arma::mat& block_model,
+                       const arma::vec& dyad_linpred,
+                       int nsim,
+                       int threads = 1)
+{
+  const arma::uword N_BLK = alpha.n_rows, N_NODE = alpha.n_cols,
+    N_STATE = alpha.n_slices, N_TIME = kappa.n_cols, N_DYAD = d_id.n_rows;
+  
+  // Each network gets its own RNG stream, seeded from R's
+  // RNG so results do not depend on the number of threads.
+  std::vector<std::uint32_t> seeds(nsim);
+  for(int n = 0; n < nsim; ++n){
+    seeds[n] = static_cast<std::uint32_t>(R::unif_rand() * 4294967295.0);
+  }
+  std::vector<std::vector<int> > edges(nsim);
+  
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(threads > 1)
+  for(int n = 0; n < nsim; ++n){
+    std::mt19937 rng(seeds[n]);
+    std::uniform_real_distribution<double> unif(0.0, 1.0);
+    
+    // HMM state of each period
+    arma::uvec state(N_TIME);
+    for(arma::uword t = 0; t < N_TIME; ++t){
+      state[t] = sampleDiscrete(kappa.colptr(t), N_STATE, arma::accu(kappa.col(t)), rng);
+    }
+    
+    // Mixed-membership vectors
+    arma::mat pi_mat(N_BLK, N_NODE);
+    arma::vec pi_tot(N_NODE, arma::fill::zeros);
+    for(arma::uword p = 0; p < N_NODE; ++p){
+      const double* alpha_p = &alpha(0, p, state[t_id_node[p]]);
+      for(arma::uword g = 0; g < N_BLK; ++g){
+        pi_mat(g, p) = std::gamma_distribution<double>(alpha_p[g], 1.0)(rng);
+        pi_tot[p] += pi_mat(g, p);
+      }
+      if(pi_tot[p] <= 0.0){
+        pi_mat.col(p).fill(1.0);
+        pi_tot[p] = N_BLK;
+      }
+    }
+    
+    // Group instantiations and edges
+    arma::uword s, r, g, h;
+    for(arma::uword d = 0; d < N_DYAD; ++d){
+      s = d_id(d, 0);
+      r = d_id(d, 1);
+      g = sampleDiscrete(pi_mat.colptr(s), N_BLK, pi_tot[s], rng);
+      h = sampleDiscrete(pi_mat.colptr(r), N_BLK, pi_tot[r], rng);
+      if(unif(rng) < 1.0 / (1.0 + exp(-(block_model(g, h) + dyad_linpred[d])))){
+        edges[n].push_back(d + 1);
+      }
+    }
+  }
+  
+  Rcpp::List res(nsim);
+  for(int n = 0; n < nsim; ++n){
+    res[n] = Rcpp::wrap(edges[n]);
+  }
+  return res;
+}
@@ -0,0 +1,318 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <RcppArmadillo.h>
+#include "AuxFuns.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ STATISTICS
+ */
+
+// Distribution of node degrees
+std::vector<double> degreeDist(const Adjacency& a, const Adjacency* b)
+{
+  arma::uword n = a.ptr.n_elem - 1;
+  std::vector<double> res;
+  for(arma::uword i = 0; i < n; ++i){
+    arma::uword deg = a.size(i) + (b ? b->size(i) : 0);
+    if(deg >= res.size()){
+      res.resize(deg + 1, 0.0);
+    }
+    res[deg]++;
+  }
+  for(arma::uword k = 0; k < res.size(); ++k){
+    res[k] /= n;
+  }
+  return res;
+}
+
+// Distribution of (undirected) geodesic distances from each source
+// node to every node, with unreachable nodes in the last element.
+std::vector<double> geodesicDist(const Adjacency& nbr, const arma::uvec& sources, int threads)
+{
+  arma::uword n = nbr.ptr.n_elem - 1, n_src = sources.n_elem;
+  arma::mat hist(n + 1, threads, arma::fill::zeros);
+#pragma omp parallel num_threads(threads) if(threads > 1)
+{
+  int thread = 0;
+#ifdef _OPENMP
+  thread = omp_get_thread_num();
+#endif
+  std::vector<arma::uword> dist(n), queue(n);
+  const arma::uword UNSEEN = n;
+#pragma omp for schedule(dynamic, 16)
+  for(arma::uword s = 0; s < n_src; ++s){
+    std::fill(dist.begin(), dist.end(), UNSEEN);
+    arma::uword head = 0, tail = 0, i;
+    dist[sources[s]] = 0;
+    queue[tail++] = sources[s];
+    while(head < tail){
+      i = queue[head++];
+      hist(dist[i], thread)++;
+      for(arma::uword j = nbr.ptr[i]; j < nbr.ptr[i + 1]; ++j){
+        if(dist[nbr.ind[j]] == UNSEEN){
+          dist[nbr.ind[j]] = dist[i] + 1;
+          queue[tail++] = nbr.ind[j];
+        }
+      }
+    }
+    hist(n, thread) += n - tail;
+  }
+}
+  arma::vec tot = arma::sum(hist, 1);
+  arma::uword max_dist = 0;
+  for(arma::uword k = 0; k < n; ++k){
+    if(tot[k] > 0){
+      max_dist = k;
+    }
+  }
+  std::vector<double> res(max_dist + 2);
+  for(arma::uword k = 0; k <= max_dist; ++k){
+    res[k] = tot[k] / (n * n_src);
+  }
+  res[max_dist + 1] = tot[n] / (n * n_src);
+  return res;
+}
+
+// Triad census (Batagelj and Mrvar, 2001), in the order
+// 003, 012, 102, 021D, 021U, 021C, 111D, 111U, 030T,
+// 030C, 201, 120D, 120U, 120C, 210, 300.
+std::vector<double> triadCensus(const Adjacency& out, const Adjacency& nbr, int threads)
+{
+  static const int TRICODES[64] = {1, 2, 2, 3, 2, 4, 6, 8, 2, 6, 5, 7, 3, 8, 7, 11,
+                                   2, 6, 4, 8, 5, 9, 9, 13, 6, 10, 9, 14, 7, 14, 12, 15,
+                                   2, 5, 6, 7, 6, 9, 10, 14, 4, 9, 9, 12, 8, 13, 14, 15,
+                                   3, 7, 8, 11, 7, 12, 14, 15, 8, 14, 13, 15, 11, 15, 15, 16};
+  arma::uword n = nbr.ptr.n_elem - 1;
+  arma::mat census(16, threads, arma::fill::zeros);
+#pragma omp parallel num_threads(threads) if(threads > 1)
+{
+  int thread = 0;
+#ifdef _OPENMP
+  thread = omp_get_thread_num();
+#endif
+  std::vector<arma::uword> s_nbr;
+#pragma omp for schedule(dynamic, 16)
+  for(arma::uword v = 0; v < n; ++v){
+    for(arma::uword a = nbr.ptr[v]; a < nbr.ptr[v + 1]; ++a){
+      arma::uword u = nbr.ind[a];
+      if(u <= v){
+        continue;
+      }
+      // Union of neighbourhoods of u and v, excluding both
+      s_nbr.clear();
+      std::set_union(nbr.ind.begin() + nbr.ptr[v], nbr.ind.begin() + nbr.ptr[v + 1],
+                     nbr.ind.begin() + nbr.ptr[u], nbr.ind.begin() + nbr.ptr[u + 1],
+                     std::back_inserter(s_nbr));
+      arma::uword n_s = s_nbr.size() - 2;
+      // Triads with a single connected dyad
+      census((out.has(v, u) && out.has(u, v)) ? 2 : 1, thread) += n - n_s - 2;
+      for(arma::uword b = 0; b < s_nbr.size(); ++b){
+        arma::uword w = s_nbr[b];
+        if((w == u) || (w == v)){
+          continue;
+        }
+        if((u < w) || ((v < w) && (w < u) && !nbr.has(v, w))){
+          int code = out.has(v, u) + 2 * out.has(u, v) + 4 * out.has(v, w)
+            + 8 * out.has(w, v) + 16 * out.has(u, w) + 32 * out.has(w, u);
+          census(TRICODES[code] - 1, thread)++;
+        }
+      }
+    }
+  }
+}
+  arma::vec tot = arma::sum(census, 1);
+  double n_triad = double(n) * (n - 1) * (n - 2) / 6.0;
+  tot[0] = n_triad - arma::accu(tot.tail(15));
+  std::vector<double> res(16);
+  for(arma::uword k = 0; k < 16; ++k){
+    res[k] = tot[k] / n_triad;
+  }
+  return res;
+}
+
+// Distributions of dyad- and edge-wise shared partners. In directed
+// networks, partners of (i, j) are nodes k with i->k->j (outgoing
+// two-paths, as in ergm's default); in undirected ones, dyads are
+// unordered pairs.
+void sharedPartners(const Adjacency& out, bool directed, int threads,
+                    std::vector<double>& dsp, std::vector<double>& esp)
+{
+  arma::uword n = out.ptr.n_elem - 1;
+  arma::mat dsp_thread(n - 1, threads, arma::fill::zeros), esp_thread(n - 1, threads, arma::fill::zeros);
+#pragma omp parallel num_threads(threads) if(threads > 1)
+{
+  int thread = 0;
+#ifdef _OPENMP
+  thread = omp_get_thread_num();
+#endif
+  std::vector<arma::uword> count(n, 0), touched;
+#pragma omp for schedule(dynamic, 16)
+  for(arma::uword i = 0; i < n; ++i){
+    touched.clear();
+    for(arma::uword a = out.ptr[i]; a < out.ptr[i + 1]; ++a){
+      arma::uword k = out.ind[a];
+      for(arma::uword b = out.ptr[k]; b < out.ptr[k + 1]; ++b){
+        arma::uword j = out.ind[b];
+        if((j == i) || (!directed && (j < i))){
+          continue;
+        }
+        if(count[j]++ == 0){
+          touched.push_back(j);
+        }
+      }
+    }
+    for(arma::uword b = 0; b < touched.size(); ++b){
+      dsp_thread(count[touched[b]], thread)++;
+    }
+    for(arma::uword a = out.ptr[i]; a < out.ptr[i + 1]; ++a){
+      arma::uword j = out.ind[a];
+      if(directed || (j > i)){
+        esp_thread(count[j], thread)++;
+      }
+    }
+    for(arma::uword b = 0; b < touched.size(); ++b){
+      count[touched[b]] = 0;
+    }
+  }
+}
+  arma::vec dsp_tot = arma::sum(dsp_thread, 1), esp_tot = arma::sum(esp_thread, 1);
+  double n_dyad = directed ? double(n) * (n - 1) : double(n) * (n - 1) / 2.0;
+  dsp_tot[0] = n_dyad - arma::accu(dsp_tot.tail(n - 2));
+  double n_edge = arma::accu(esp_tot);
+  dsp.resize(n - 1);
+  esp.resize(n - 1);
+  for(arma::uword k = 0; k < n - 1; ++k){
+    dsp[k] = dsp_tot[k] / n_dyad;
+    esp[k] = n_edge > 0 ? esp_tot[k] / n_edge : 0.0;
+  }
+}
+
+// Distribution of k-stars, k = 0, ..., n - 1, from
+// the (in-)degree distribution. Computed on the log
+// scale, since counts overflow in large networks.
+std::vector<double> kstarDist(const std::vector<double>& deg_dist, arma::uword n)
+{
+  std::vector<double> res(n, 0.0);
+  arma::vec log_star(deg_dist.size());
+  // Log-factorials by summation, since this runs in worker
+  // threads where R's (and lgamma's) state must not be touched
+  arma::vec log_fact(deg_dist.size() + 1, arma::fill::zeros);
+  for(arma::uword d = 2; d <= deg_dist.size(); ++d){
+    log_fact[d] = log_fact[d - 1] + log(double(d));
+  }
+  for(arma::uword k = 0; k < deg_dist.size(); ++k){
+    arma::vec terms(deg_dist.size() - k);
+    for(arma::uword d = k; d < deg_dist.size(); ++d){
+      terms[d - k] = deg_dist[d] > 0
+        ? log(deg_dist[d]) + log_fact[d] - log_fact[k] - log_fact[d - k] : -arma::datum::inf;
+    }
+    log_star[k] = logSumExp(terms);
+  }
+  double log_tot = logSumExp(log_star);
+  for(arma::uword k = 0; k < deg_dist.size(); ++k){
+    res[k] = exp(log_star[k] - log_tot);
+  }
+  return res;
+}
+
+/**
+ EXPORTED ENGINE
+ */
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+Rcpp::List gofStats(Rcpp::List nets,
+                    Rcpp::CharacterVector gof_stat,
+                    bool directed,
+                    int geo_sources = 0,
+                    int threads = 1)
+{
+  const arma::uword N_NET = nets.size(), N_STAT = gof_stat.size();
+  if(threads < 1){
+    threads = 1;
+  }
+  std::vector<std::string> stats(N_STAT);
+  for(arma::uword s = 0; s < N_STAT; ++s){
+    stats[s] = Rcpp::as<std::string>(gof_stat[s]);
+  }
+
+  // Copy inputs (and draw BFS sources) before any threads start
+  std::vector<arma::uword> n_nodes(N_NET);
+  std::vector<arma::uvec> send(N_NET), rec(N_NET), sources(N_NET);
+  for(arma::uword i = 0; i < N_NET; ++i){
+    Rcpp::List net = nets[i];
+    n_nodes[i] = Rcpp::as<arma::uword>(net["n"]);
+    arma::umat edges = Rcpp::as<arma::umat>(net["edges"]);
+    send[i] = edges.col(0);
+    rec[i] = edges.col(1);
+    if((geo_sources > 0) && (arma::uword(geo_sources) < n_nodes[i])){
+      sources[i] = arma::randperm(n_nodes[i], geo_sources);
+    } else {
+      sources[i] = arma::regspace<arma::uvec>(0, n_nodes[i] - 1);
+    }
+  }
+
+  // Parallelize over networks when there are enough of them;
+  // otherwise, over nodes within each network.
+  const bool by_net = int(N_NET) >= threads;
+  const int inner_threads = by_net ? 1 : threads;
+  std::vector<std::vector<std::vector<double> > > res(N_STAT, std::vector<std::vector<double> >(N_NET));
+#pragma omp parallel for schedule(dynamic) num_threads(threads) if(by_net && (threads > 1))
+  for(arma::uword i = 0; i < N_NET; ++i){
+    arma::uword n = n_nodes[i];
+    if(n < 3){
+      continue;
+    }
+    arma::uvec both_from = arma::join_cols(send[i], rec[i]), both_to = arma::join_cols(rec[i], send[i]);
+    Adjacency nbr(n, both_from, both_to);
+    Adjacency out = directed ? Adjacency(n, send[i], rec[i]) : nbr;
+    Adjacency in = directed ? Adjacency(n, rec[i], send[i]) : nbr;
+    std::vector<double> dsp, esp;
+    for(arma::uword s = 0; s < N_STAT; ++s){
+      const std::string& stat = stats[s];
+      if(stat == "Indegree"){
+        res[s][i] = degreeDist(in, NULL);
+      } else if(stat == "Outdegree"){
+        res[s][i] = degreeDist(out, NULL);
+      } else if(stat == "Degree"){
+        res[s][i] = directed ? degreeDist(out, &in) : degreeDist(nbr, NULL);
+      } else if(stat == "Geodesics"){
+        res[s][i] = geodesicDist(nbr, sources[i], inner_threads);
+      } else if(stat == "3-Motifs"){
+        res[s][i] = triadCensus(out, nbr, inner_threads);
+      } else if((stat == "Dyad Shared Partners") || (stat == "Edge Shared Partners")){
+        if(dsp.empty()){
+          sharedPartners(out, directed, inner_threads, dsp, esp);
+        }
+        res[s][i] = (stat == "Dyad Shared Partners") ? dsp : esp;
+      } else if(stat == "Incoming K-stars"){
+        res[s][i] = kstarDist(degreeDist(in, NULL), n);
+      }
+    }
+  }
+
+  // Named vectors, with names giving the value of each statistic
+  Rcpp::List res_r(N_STAT);
+  for(arma::uword s = 0; s < N_STAT; ++s){
+    Rcpp::List stat_r(N_NET);
+    for(arma::uword i = 0; i < N_NET; ++i){
+      Rcpp::NumericVector vals = Rcpp::wrap(res[s][i]);
+      Rcpp::CharacterVector val_names(vals.size());
+      for(int k = 0; k < vals.size(); ++k){
+        val_names[k] = std::to_string(stats[s] == "3-Motifs" ? k + 1 : k);
+      }
+      if((stats[s] == "Geodesics") && (vals.size() > 0)){
+        val_names[vals.size() - 1] = "Inf";
+      }
+      vals.names() = val_names;
+      stat_r[i] = vals;
+    }
+    res_r[s] = stat_r;
+  }
+  res_r.names() = gof_stat;
+  return res_r;
+}
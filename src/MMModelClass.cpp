@@ -5,15 +5,15 @@
  CONSTRUCTOR
  */
 
-MMModel::MMModel(const arma::mat& z_t,
+MMModel::MMModel(const arma::mat& z_t_in,
                  //const arma::mat& z_t_ho,
-                 const arma::mat& x_t,
-                 const arma::vec& y,
+                 const arma::mat& x_t_in,
+                 const arma::vec& y_in,
                  //const arma::vec& y_ho,
-                 const arma::uvec& time_id_dyad,
+                 const arma::uvec& time_id_dyad_in,
                  const arma::uvec& time_id_node,
                  const arma::uvec& nodes_per_period,
-                 const arma::umat& node_id_dyad,
+                 const arma::umat& node_id_dyad_in,
                  //const arma::umat& node_id_dyad_ho,
                  const arma::field<arma::uvec>& node_id_period,
                  const arma::mat& mu_b,
@@ -31,16 +31,17 @@ MMModel::MMModel(const arma::mat& z_t,
                  Rcpp::List& control)
   :
   N_NODE(sum(nodes_per_period)),
-  N_DYAD(y.n_elem),
+  N_DYAD(y_in.n_elem),
   N_BLK(control["blocks"]),
   N_STATE(control["states"]),
   N_TIME(control["times"]),
-  N_MONAD_PRED(x_t.n_rows),
-  N_DYAD_PRED(arma::any(z_t.row(0)) ? z_t.n_rows : 0),
+  N_MONAD_PRED(x_t_in.n_rows),
+  N_DYAD_PRED(arma::any(z_t_in.row(0)) ? z_t_in.n_rows : 0),
   N_B_PAR(Rcpp::as<bool>(control["directed"]) ? N_BLK * N_BLK : N_BLK * (1 + N_BLK) / 2),
   OPT_ITER(control["opt_iter"]),
   N_NODE_BATCH(arma::sum(Rcpp::as<arma::uvec>(control["batch_size"]))),
   N_THREAD(control["threads"]),
+  LBFGS_MEM(Rcpp::as<bool>(control["lbfgs"]) ? Rcpp::as<int>(control["lbfgs_mem"]) : 0),
   //N_DYAD_HO(y_ho.n_elem),
   eta(Rcpp::as<double>(control["eta"])),
   forget_rate(Rcpp::as<double>(control["forget_rate"])),
@@ -60,11 +61,16 @@ MMModel::MMModel(const arma::mat& z_t,
   grcountTheta(0),
   m_failAlpha(0),
   m_failTheta(0),
+  n_phi_fallback(0),
   verbose(Rcpp::as<bool>(control["verbose"])),
   directed(Rcpp::as<bool>(control["directed"])),
-  y(y),
+  copy_dyads(Rcpp::as<bool>(control["reorder_dyads"])),
+  dyad_order(dyadOrder(node_id_dyad_in, copy_dyads)),
+  y_own(copy_dyads ? arma::vec(y_in.elem(dyad_order)) : arma::vec()),
+  y(copy_dyads ? const_cast<double*>(y_own.memptr()) : const_cast<double*>(y_in.memptr()),
+    y_in.n_elem, false, true),
   //y_ho(y_ho),
-  time_id_dyad(time_id_dyad),
+  time_id_dyad(arma::conv_to<dyad_uvec>::from(arma::uvec(time_id_dyad_in.elem(dyad_order)))),
   time_id_node(time_id_node),
   n_nodes_time(nodes_per_period),
   n_nodes_batch(Rcpp::as<arma::uvec>(control["batch_size"])),
@@ -73,6 +79,9 @@ MMModel::MMModel(const arma::mat& z_t,
   node_in_batch(N_NODE, arma::fill::ones),
   dyad_in_batch(N_DYAD, arma::fill::ones),
   node_batch(N_NODE_BATCH, arma::fill::zeros),
+  dyad_batch(N_DYAD),
+  node_dyad_ptr(N_NODE + 1, arma::fill::zeros),
+  node_dyad_ind(2 * N_DYAD),
   maskalpha(N_MONAD_PRED * N_BLK * N_STATE, 1),
   masktheta(N_B_PAR + N_DYAD_PRED, 1),
   node_id_period(node_id_period),
@@ -83,35 +92,59 @@ MMModel::MMModel(const arma::mat& z_t,
   theta_gr(N_B_PAR + N_DYAD_PRED, arma::fill::zeros),
   gamma(gamma_init_r),
   gamma_init(gamma_init_r),
-  node_id_dyad(node_id_dyad),
+  dyad_linpred(N_DYAD, arma::fill::zeros),
+  node_id_dyad(arma::conv_to<dyad_umat>::from(arma::umat(node_id_dyad_in.rows(dyad_order)))),
   //node_id_dyad_ho(node_id_dyad_ho),
   par_ind(N_BLK, N_BLK, arma::fill::zeros),
-  x_t(x_t),
-  z_t(z_t),
+  ooc_dir(Rcpp::as<std::string>(control["ooc_dir"])),
+  z_buf(copy_dyads ? z_t_in.n_elem * sizeof(double) : 0, ooc_dir, !Rcpp::as<bool>(control["svi"])),
+  send_phi_buf(N_BLK * N_DYAD * sizeof(phi_type), ooc_dir, !Rcpp::as<bool>(control["svi"])),
+  rec_phi_buf(N_BLK * N_DYAD * sizeof(phi_type), ooc_dir, !Rcpp::as<bool>(control["svi"])),
+  x_t(const_cast<double*>(x_t_in.memptr()), x_t_in.n_rows, x_t_in.n_cols, false, true),
+  z_t(copy_dyads ? z_buf.ptr<double>() : const_cast<double*>(z_t_in.memptr()),
+      z_t_in.n_rows, z_t_in.n_cols, false, true),
   //z_t_ho(z_t_ho),
   mu_b_t(mu_b),
   var_b_t(var_b),
   kappa_t(kappa_init_t),
   b_t(b_init_t),
   alpha_term(N_STATE, N_TIME, arma::fill::zeros),
-  send_phi(N_BLK, N_DYAD, arma::fill::zeros),
-  rec_phi(N_BLK, N_DYAD, arma::fill::zeros),
+  send_phi(send_phi_buf.ptr<phi_type>(), N_BLK, N_DYAD, false, true),
+  rec_phi(rec_phi_buf.ptr<phi_type>(), N_BLK, N_DYAD, false, true),
   e_wmn_t(N_STATE, N_STATE, arma::fill::zeros),
   e_c_t(N_BLK, N_NODE, arma::fill::zeros),
+  theta_gr_thread(N_B_PAR + N_DYAD_PRED + 1, N_THREAD > 1 ? N_THREAD : 1, arma::fill::zeros),
+  phi_scratch(N_BLK, N_THREAD > 1 ? N_THREAD : 1, arma::fill::zeros),
   alpha(N_BLK, N_NODE, N_STATE, arma::fill::zeros),
-  theta(N_BLK, N_BLK, N_DYAD, arma::fill::zeros),
   beta(beta_init_r),
   betaold(beta_init_r),
-  beta_init(beta_init_r)
-  //new_e_c_t(N_THREAD, Array<double>({N_BLK, N_NODE}, 0.0)
-  //new_e_c_t(N_BLK, N_NODE, arma::fill::zeros)
+  beta_init(beta_init_r),
+  new_e_c_t(N_BLK, N_NODE, N_THREAD > 1 ? N_THREAD : 0, arma::fill::zeros)
 {
+#ifdef NETMIX_COMPACT
+  if(N_DYAD > std::numeric_limits<dyad_uword>::max()){
+    Rcpp::stop("Too many dyads for compact storage mode.");
+  }
+#endif
   //Set number of parallel threads
 #ifdef _OPENMP
   omp_set_num_threads(N_THREAD);
 #endif
   
-
+  
+  //Dyad-level predictors, in internal dyad order
+  if(copy_dyads){
+    for(arma::uword d = 0; d < N_DYAD; ++d){
+      std::copy(z_t_in.colptr(dyad_order[d]), z_t_in.colptr(dyad_order[d]) + z_t_in.n_rows,
+                z_buf.ptr<double>() + d * z_t_in.n_rows);
+    }
+  }
+  
+  //All dyads are in the batch until
+  //sampleDyads is first called
+  std::iota(dyad_batch.begin(), dyad_batch.end(), 0);
+  first_batch = true;
+  
   //Assign initial values to W parameters
   for(arma::uword t = 1; t < N_TIME; ++t){
     for(arma::uword m = 0; m < N_STATE; ++m){
@@ -136,6 +169,16 @@ MMModel::MMModel(const arma::mat& z_t,
       e_c_t(g, q) += rec_phi(g, d);
     }
   }
+  //Create node-to-dyad index (CSR)
+  for(arma::uword p = 0; p < N_NODE; ++p){
+    node_dyad_ptr[p + 1] = node_dyad_ptr[p] + tot_nodes[p];
+  }
+  arma::uvec next_pos(node_dyad_ptr.begin(), N_NODE);
+  for(arma::uword d = 0; d < N_DYAD; ++d){
+    node_dyad_ind[next_pos[node_id_dyad(d, 0)]++] = d;
+    node_dyad_ind[next_pos[node_id_dyad(d, 1)]++] = d;
+  }
+  
   //Create matrix of theta parameter indeces
   //(for undirected networks should force
   //symmetric blockmodel)
@@ -169,6 +212,31 @@ MMModel::MMModel(const arma::mat& z_t,
   computeAlpha();
   computeTheta();
   
+  //Dyads in fixed periods keep their variational parameters.
+  //They are left out of every batch, and their part of the
+  //theta bound is replaced by its expansion at the initial theta.
+  arma::uvec fixed_times = Rcpp::as<arma::uvec>(control["fixed_times"]);
+  fixed_dyads = fixed_times.n_elem > 0;
+  theta_off_val = 0.0;
+  if(fixed_dyads){
+    arma::uvec time_fixed(N_TIME, arma::fill::zeros);
+    time_fixed.elem(fixed_times).ones();
+    arma::uword n_fixed = 0, i_fixed = 0, i_est = 0;
+    for(arma::uword d = 0; d < N_DYAD; ++d){
+      n_fixed += time_fixed[time_id_dyad[d]];
+    }
+    dyad_uvec fixed(n_fixed);
+    dyad_batch.set_size(N_DYAD - n_fixed);
+    for(arma::uword d = 0; d < N_DYAD; ++d){
+      if(time_fixed[time_id_dyad[d]]){
+        fixed[i_fixed++] = d;
+      } else {
+        dyad_batch[i_est++] = d;
+      }
+    }
+    computeThetaOffset(fixed);
+  }
+  
   
   //Define iterator at the end of param. objects
   beta_end = beta.end();
@@ -189,9 +257,10 @@ MMModel::~MMModel()
 double MMModel::alphaLB(bool all)
 {
   computeAlpha(all);
-  double res = 0.0, res_int = 0.0, alpha_row = 0.0, alpha_val = 0.0;
+  double res = 0.0, res_state, res_int = 0.0, alpha_row = 0.0, alpha_val = 0.0;
   for(arma::uword m = 0; m < N_STATE; ++m){
-#pragma omp parallel for firstprivate(alpha_val, alpha_row, res_int) reduction(+: res)
+    res_state = 0.0;
+#pragma omp parallel for firstprivate(alpha_val, alpha_row, res_int) reduction(+: res_state)
     for(arma::uword p = 0; p < N_NODE; ++p){
       if((node_in_batch[p] == 1) || all){
       alpha_row = 0.0;
@@ -202,10 +271,10 @@ double MMModel::alphaLB(bool all)
         res_int += (lgamma(alpha_val + e_c_t(g, p)) - lgamma(alpha_val));
       }
       res_int += (lgamma(alpha_row) - lgamma(alpha_row + tot_nodes[p]));
-      res += res_int * kappa_t(m, time_id_node[p]);
+      res_state += res_int * kappa_t(m, time_id_node[p]);
       }
     }
-    res *=  all ? 1.0 : (1. * N_NODE)/N_NODE_BATCH;
+    res += res_state * (all ? 1.0 : (1. * N_NODE)/N_NODE_BATCH);
     //Prior for beta
 
     for(arma::uword g = 0; g < N_BLK; ++g){
@@ -222,37 +291,61 @@ double MMModel::alphaLB(bool all)
  ALPHA GRADIENT
  */
 
-
-
-void MMModel::alphaGr(int N_PAR, double *gr)
+// Assumes alpha is current (i.e. computeAlpha has been called
+// at the present value of beta). For each state, the digamma terms
+// are evaluated once per node and block, and the gradient for all
+// predictors is obtained from a single product with x_t. If value
+// is true, alphaLB() at the same point is also returned, since it
+// only needs the lgamma counterparts of the same terms.
+double MMModel::alphaGr(int N_PAR, double *gr, bool value)
 {
-  double res=0.0, alpha_row=0.0, prior_gr=0.0;
+  double res = 0.0, res_state, res_int, row_term, alpha_row, alpha_val, kappa_val, prior_gr;
+  double correct_fact = (1. * N_NODE) / N_NODE_BATCH;
   arma::uword U_NPAR = N_PAR;
+  arma::mat gr_weight(N_BLK, N_NODE), gr_state;
   for(arma::uword m = 0; m < N_STATE; ++m){
-    for(arma::uword g = 0; g < N_BLK; ++g){
-      for(arma::uword x = 0; x < N_MONAD_PRED; ++x){
-        res = 0.0;
-#pragma omp parallel for firstprivate(alpha_row) reduction(+: res)
-        for(arma::uword p = 0; p < N_NODE; ++p){
-          if(node_in_batch[p] == 1) {
-            alpha_row = 0.0;
-            for(arma::uword h = 0; h < N_BLK; ++h){
-              alpha_row += alpha(h, p, m);
-            }
-            res += (R::digamma(alpha_row) - R::digamma(alpha_row + tot_nodes[p])
-                      + R::digamma(alpha(g, p, m) + e_c_t(g, p)) - R::digamma(alpha(g, p, m)))
-              * kappa_t(m,  time_id_node[p]) * alpha(g, p, m) * x_t(x, p);
+    res_state = 0.0;
+#pragma omp parallel for private(res_int, row_term, alpha_row, alpha_val, kappa_val) reduction(+: res_state)
+    for(arma::uword p = 0; p < N_NODE; ++p){
+      if(node_in_batch[p] == 1) {
+        alpha_row = 0.0;
+        for(arma::uword h = 0; h < N_BLK; ++h){
+          alpha_row += alpha(h, p, m);
+        }
+        kappa_val = kappa_t(m, time_id_node[p]);
+        row_term = R::digamma(alpha_row) - R::digamma(alpha_row + tot_nodes[p]);
+        res_int = 0.0;
+        if(value){
+          res_int += lgamma(alpha_row) - lgamma(alpha_row + tot_nodes[p]);
+        }
+        for(arma::uword g = 0; g < N_BLK; ++g){
+          alpha_val = alpha(g, p, m);
+          gr_weight(g, p) = (row_term + R::digamma(alpha_val + e_c_t(g, p)) - R::digamma(alpha_val))
+            * kappa_val * alpha_val;
+          if(value){
+            res_int += lgamma(alpha_val + e_c_t(g, p)) - lgamma(alpha_val);
           }
         }
-        res *= (1. * N_NODE) / N_NODE_BATCH;
+        res_state += res_int * kappa_val;
+      } else {
+        gr_weight.col(p).zeros();
+      }
+    }
+    res += res_state * correct_fact;
+    
+    gr_state = x_t * gr_weight.t(); // N_MONAD_PRED x N_BLK
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      for(arma::uword x = 0; x < N_MONAD_PRED; ++x){
         prior_gr = (beta(x, g, m) - mu_beta(x, g, m)) / var_beta(x, g, m);
-        gr[x + N_MONAD_PRED * (g + N_BLK * m)] = -(res - prior_gr);
+        gr[x + N_MONAD_PRED * (g + N_BLK * m)] = -(gr_state(x, g) * correct_fact - prior_gr);
+        res -= 0.5 * pow(beta(x, g, m) - mu_beta(x, g, m), 2.0) / var_beta(x, g, m);
       }
     }
   }
   for(arma::uword i = 0; i < U_NPAR; ++i)
   gr[i] /= N_NODE;
   
+  return -res/N_NODE;
 }
 
 
@@ -293,26 +386,36 @@ void MMModel::computeAlpha(bool all)
 
 double MMModel::thetaLB(bool entropy, bool all)
 {
-  computeTheta();
+  computeTheta(all);
 
-  double res = 0.0;
-#pragma omp parallel for reduction(+: res)
-  for(arma::uword d = 0; d < N_DYAD; ++d){
-    if((dyad_in_batch[d] == 1) || all){
+  double res = 0.0, linpred;
+  arma::uword d, N_LOOP = all ? N_DYAD : dyad_batch.n_elem;
+#pragma omp parallel for private(linpred, d) reduction(+: res)
+  for(arma::uword i = 0; i < N_LOOP; ++i){
+    d = all ? i : dyad_batch[i];
     for(arma::uword g = 0; g < N_BLK; ++g){
       if(entropy){
-        res -= send_phi(g, d) * log(send_phi(g, d))
-        + rec_phi(g, d) * log(rec_phi(g, d));
+        // 0 * log(0) = 0; stored phi can underflow
+        // to zero, especially in compact (float) mode
+        if(send_phi(g, d) > 0.0){
+          res -= send_phi(g, d) * log(send_phi(g, d));
+        }
+        if(rec_phi(g, d) > 0.0){
+          res -= rec_phi(g, d) * log(rec_phi(g, d));
+        }
       }
       for(arma::uword h = 0; h < N_BLK; ++h){
+        // y * log(theta) + (1 - y) * log(1 - theta)
+        linpred = b_t(h, g) + dyad_linpred[d];
         res += send_phi(g, d) * rec_phi(h, d)
-        * (y[d] * log(theta(h, g, d))
-             + (1.0 - y[d]) * log(1.0 - theta(h, g, d)));
+        * (y[d] * linpred - log1pExp(linpred));
       }
     }
-    }
   }
   res *= all ? 1.0 : reweightFactor;
+  if(!all){
+    res += thetaOffset(NULL);
+  }
 
   //Prior for gamma
   for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
@@ -333,45 +436,76 @@ double MMModel::thetaLB(bool entropy, bool all)
 /**
  GRADIENT FOR THETA
  */
-void MMModel::thetaGr(int N_PAR, double *gr)
+// Assumes b_t and dyad_linpred are current (i.e. computeTheta
+// has been called at the present value of theta_par). If value
+// is true, also returns thetaLB() at the same point, accumulated
+// in the same sweep.
+double MMModel::thetaGr(int N_PAR, double *gr, bool value)
 {
 
-  arma::uword U_NPAR = N_PAR;
-  double res_local, res = 0.0;
-  for(arma::uword i = 0; i < U_NPAR; ++i){
-    gr[i] = 0.0;
-  }
+  arma::uword U_NPAR = N_PAR, N_BATCH = dyad_batch.n_elem, npar;
+  theta_gr_thread.zeros();
   
-  arma::uword npar = 0;
-    for(arma::uword d = 0; d < N_DYAD; ++d){
-      if(dyad_in_batch[d] == 1){
-      res = 0.0;
-      for(arma::uword g = 0; g < N_BLK; ++g){
-        for(arma::uword h = 0; h < N_BLK; ++h){
-          res_local = send_phi(g, d) * rec_phi(h, d) * (y[d] - theta(h, g, d));
-          res += res_local;
-          if((h < g) && !directed){
-            continue;
-          }
-          npar = par_ind(h, g);
-          gr[npar] -= res_local;
+  // Each thread accumulates into its own column of theta_gr_thread
+  // (last row holds the bound); with a static schedule the columns
+  // are summed in thread order, so the result is reproducible for
+  // a fixed number of threads.
+#pragma omp parallel for schedule(static) if(N_THREAD > 1)
+  for(arma::uword i = 0; i < N_BATCH; ++i){
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    double *gr_local = theta_gr_thread.colptr(thread);
+    double linpred, exp_term, weight, res_local, res = 0.0, res_val = 0.0;
+    arma::uword d = dyad_batch[i];
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      for(arma::uword h = 0; h < N_BLK; ++h){
+        // log(1 + exp(linpred)) and logistic(linpred) from one exp
+        linpred = b_t(h, g) + dyad_linpred[d];
+        exp_term = exp(-fabs(linpred));
+        weight = send_phi(g, d) * rec_phi(h, d);
+        if(value){
+          res_val += weight * (y[d] * linpred - (linpred > 0.0 ? linpred : 0.0) - log1p(exp_term));
         }
-      }
-      if(N_DYAD_PRED > 0){
-        for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
-          gr[N_B_PAR + z] -= res * z_t(z, d);
+        res_local = weight
+          * (y[d] - (linpred > 0.0 ? 1. : exp_term) / (1. + exp_term));
+        res += res_local;
+        if((h < g) && !directed){
+          continue;
         }
+        gr_local[par_ind(h, g)] -= res_local;
       }
     }
+    if(N_DYAD_PRED > 0){
+      for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
+        gr_local[N_B_PAR + z] -= res * z_t(z, d);
+      }
+    }
+    gr_local[U_NPAR] += res_val;
+  }
+  double res_val = 0.0;
+  for(arma::uword thread = 0; thread < theta_gr_thread.n_cols; ++thread){
+    res_val += theta_gr_thread(U_NPAR, thread);
+  }
+  res_val *= reweightFactor;
+  for(arma::uword i = 0; i < U_NPAR; ++i){
+    gr[i] = 0.0;
+    for(arma::uword thread = 0; thread < theta_gr_thread.n_cols; ++thread){
+      gr[i] += theta_gr_thread(i, thread);
+    }
   }
   for(arma::uword i = 0; i < U_NPAR; ++i){
     gr[i] *= reweightFactor; //for stochastic VI
   }
+  res_val += thetaOffset(gr);
   for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
     gr[N_B_PAR + z] += (gamma[z] - mu_gamma[z]) / var_gamma[z];
+    res_val -= 0.5*pow(gamma[z] - mu_gamma[z], 2.0) / var_gamma[z];
   }
   for(arma::uword g = 0; g < N_BLK; ++g){
     for(arma::uword h = 0; h < N_BLK; ++h){
+      res_val -= 0.5*(pow(b_t(h, g) - mu_b_t(h, g), 2.0) / var_b_t(h, g));
       if((h < g) && !directed){
         continue;
       }
@@ -381,6 +515,94 @@ void MMModel::thetaGr(int N_PAR, double *gr)
   }
   for(arma::uword i = 0; i < U_NPAR; ++i)
     gr[i] /= N_DYAD;
+  
+  return -res_val/N_DYAD;
+}
+
+
+/**
+ THETA BOUND OF FIXED DYADS
+ */
+
+// Value, gradient and Hessian of the (unscaled, prior-free) theta
+// bound of the given dyads, at the current theta. One pass over
+// the dyads; afterwards they only enter through thetaOffset.
+// For undirected networks, the gradient only runs over block
+// pairs with h >= g (as in thetaGr), so the Hessian is
+// symmetrized to keep thetaOffset's value and gradient consistent.
+void MMModel::computeThetaOffset(const dyad_uvec& fixed)
+{
+  const arma::uword N_PAR = N_B_PAR + N_DYAD_PRED;
+  theta_off_par = theta_par;
+  theta_off_gr.zeros(N_PAR);
+  theta_off_hess.zeros(N_PAR, N_PAR);
+  theta_off_val = 0.0;
+  // Curvature terms per blockmodel parameter: s_gr only over the
+  // block pairs that enter its gradient, s_all over all of them
+  arma::vec s_gr(N_B_PAR), s_all(N_B_PAR);
+  double linpred, exp_term, prob, weight, curv, res, res_curv, edge;
+  arma::uword d, npar;
+  for(arma::uword i = 0; i < fixed.n_elem; ++i){
+    d = fixed[i];
+    edge = y[d];
+    s_gr.zeros();
+    s_all.zeros();
+    res = 0.0;
+    res_curv = 0.0;
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      for(arma::uword h = 0; h < N_BLK; ++h){
+        linpred = b_t(h, g) + dyad_linpred[d];
+        exp_term = exp(-fabs(linpred));
+        prob = (linpred > 0.0 ? 1. : exp_term) / (1. + exp_term);
+        weight = send_phi(g, d) * rec_phi(h, d);
+        curv = weight * prob * (1. - prob);
+        theta_off_val += weight * (edge * linpred - log1pExp(linpred));
+        res += weight * (edge - prob);
+        res_curv += curv;
+        npar = par_ind(h, g);
+        s_all[npar] += curv;
+        if((h < g) && !directed){
+          continue;
+        }
+        theta_off_gr[npar] += weight * (edge - prob);
+        s_gr[npar] += curv;
+      }
+    }
+    for(arma::uword k = 0; k < N_B_PAR; ++k){
+      theta_off_hess(k, k) -= s_gr[k];
+    }
+    for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
+      theta_off_gr[N_B_PAR + z] += res * z_t(z, d);
+      for(arma::uword k = 0; k < N_B_PAR; ++k){
+        theta_off_hess(k, N_B_PAR + z) -= s_gr[k] * z_t(z, d);
+        theta_off_hess(N_B_PAR + z, k) -= s_all[k] * z_t(z, d);
+      }
+      for(arma::uword z2 = 0; z2 < N_DYAD_PRED; ++z2){
+        theta_off_hess(N_B_PAR + z, N_B_PAR + z2) -= res_curv * z_t(z, d) * z_t(z2, d);
+      }
+    }
+  }
+  if(!directed){
+    theta_off_hess = 0.5 * (theta_off_hess + theta_off_hess.t());
+  }
+}
+
+// Expansion of the fixed dyads' bound at the current theta
+// (zero if there are none); its gradient is subtracted from
+// gr, unless gr is NULL.
+double MMModel::thetaOffset(double *gr)
+{
+  if(!fixed_dyads){
+    return 0.0;
+  }
+  arma::vec delta = theta_par - theta_off_par,
+    hess_delta = theta_off_hess * delta;
+  if(gr != NULL){
+    for(arma::uword i = 0; i < delta.n_elem; ++i){
+      gr[i] -= theta_off_gr[i] + hess_delta[i];
+    }
+  }
+  return theta_off_val + arma::dot(theta_off_gr, delta) + 0.5 * arma::dot(delta, hess_delta);
 }
 
 
@@ -395,20 +617,21 @@ void MMModel::computeTheta(bool all)
       b_t(h, g) = theta_par[par_ind(h, g)];
     }
   }
+  for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
+    gamma[z] = theta_par[N_B_PAR + z];
+  }
+  if(N_DYAD_PRED == 0){
+    return;
+  }
   double linpred;
-  for(arma::uword d = 0; d < N_DYAD; ++d){
-    if((dyad_in_batch[d] == 1) || all){
+  arma::uword d, N_LOOP = all ? N_DYAD : dyad_batch.n_elem;
+  for(arma::uword i = 0; i < N_LOOP; ++i){
+    d = all ? i : dyad_batch[i];
     linpred = 0.0;
     for(arma::uword z = 0; z < N_DYAD_PRED; ++z){
-      gamma[z] = theta_par[N_B_PAR + z];
-      linpred -= z_t(z, d) * gamma[z];
-    }
-    for(arma::uword g = 0; g < N_BLK; ++g){
-      for(arma::uword h = 0; h < N_BLK; ++h){
-        theta(h, g, d) = 1./(1 + exp(linpred - b_t(h, g)));
-      }
+      linpred += z_t(z, d) * gamma[z];
     }
-  }
+    dyad_linpred[d] = linpred;
   }
 }
 
@@ -434,8 +657,14 @@ void MMModel::optim_ours(bool alpha)
     betaold = beta;
     //std::copy(beta_init.begin(), beta_init.end(), beta.begin());
     //beta.zeros();
-    vmmin_ours(npar, &beta[0], &fminAlpha, alphaLBW, alphaGrW, OPT_ITER, 0,
-                &maskalpha[0], -1.0e+35, 1.0e-6, 1, this, &fncountAlpha, &grcountAlpha, &m_failAlpha);
+    if(LBFGS_MEM > 0){
+      lbfgs_ours(npar, &beta[0], &fminAlpha, alphaLBW, alphaGrW, alphaLBGrW, OPT_ITER, 0,
+                 &maskalpha[0], -1.0e+35, 1.0e-6, 1, this, &fncountAlpha, &grcountAlpha, &m_failAlpha,
+                 LBFGS_MEM);
+    } else {
+      vmmin_ours(npar, &beta[0], &fminAlpha, alphaLBW, alphaGrW, alphaLBGrW, OPT_ITER, 0,
+                 &maskalpha[0], -1.0e+35, 1.0e-6, 1, this, &fncountAlpha, &grcountAlpha, &m_failAlpha);
+    }
     
     for(arma::uword i = 0; i < npar; ++i){
       beta[i] = (1.0 - step_size) * betaold[i] + step_size * beta[i];
@@ -455,8 +684,14 @@ void MMModel::optim_ours(bool alpha)
     thetaold = theta_par;
     //theta_par.zeros();
     //std::copy(gamma_init.begin(), gamma_init.end(), theta_par.begin() + N_B_PAR);
-    vmmin_ours(npar, &theta_par[0], &fminTheta, thetaLBW, thetaGrW, OPT_ITER, 0,
-                &masktheta[0], -1.0e+35, 1.0e-6, 1, this, &fncountTheta, &grcountTheta, &m_failTheta);
+    if(LBFGS_MEM > 0){
+      lbfgs_ours(npar, &theta_par[0], &fminTheta, thetaLBW, thetaGrW, thetaLBGrW, OPT_ITER, 0,
+                 &masktheta[0], -1.0e+35, 1.0e-6, 1, this, &fncountTheta, &grcountTheta, &m_failTheta,
+                 LBFGS_MEM);
+    } else {
+      vmmin_ours(npar, &theta_par[0], &fminTheta, thetaLBW, thetaGrW, thetaLBGrW, OPT_ITER, 0,
+                 &masktheta[0], -1.0e+35, 1.0e-6, 1, this, &fncountTheta, &grcountTheta, &m_failTheta);
+    }
     
     for(arma::uword i = 0; i < npar; ++i){
       theta_par[i] = (1.0 - step_size) * thetaold[i] + step_size * theta_par[i];
@@ -475,7 +710,12 @@ double MMModel::thetaLBW(int n, double *par, void *ex)
 }
 void MMModel::thetaGrW(int n, double *par, double *gr, void *ex)
 {
-  static_cast<MMModel*>(ex)->thetaGr(n, gr);
+  static_cast<MMModel*>(ex)->thetaGr(n, gr, false);
+}
+double MMModel::thetaLBGrW(int n, double *par, double *gr, void *ex)
+{
+  static_cast<MMModel*>(ex)->computeTheta();
+  return(static_cast<MMModel*>(ex)->thetaGr(n, gr));
 }
 double MMModel::alphaLBW(int n, double *par, void *ex)
 {
@@ -483,7 +723,12 @@ double MMModel::alphaLBW(int n, double *par, void *ex)
 }
 void MMModel::alphaGrW(int n, double *par, double *gr, void *ex)
 {
-  static_cast<MMModel*>(ex)->alphaGr(n, gr);
+  static_cast<MMModel*>(ex)->alphaGr(n, gr, false);
+}
+double MMModel::alphaLBGrW(int n, double *par, double *gr, void *ex)
+{
+  static_cast<MMModel*>(ex)->computeAlpha();
+  return(static_cast<MMModel*>(ex)->alphaGr(n, gr));
 }
 
 double MMModel::LB()
@@ -530,6 +775,11 @@ double MMModel::LL()
 void MMModel::updateKappa()
 {
   Rcpp::checkUserInterrupt();
+  // Kappa depends on the alpha terms of all nodes; under
+  // stochastic VI, updatePhi left batch estimates in alpha_term.
+  if(N_NODE_BATCH < N_NODE){
+    computeAlpha(true);
+  }
   arma::vec kappa_vec(N_STATE, arma::fill::zeros);
   double res, log_denom;
   for(arma::uword t = 1; t < N_TIME; ++t){
@@ -596,97 +846,19 @@ void MMModel::updateKappa()
  VARIATIONAL UPDATE FOR PHI
  */
 
-// void MMModel::updatePhiInternal(arma::uword dyad,
-//                                 arma::uword rec,
-//                                 double *phi,
-//                                 double *phi_o,
-//                                 double *new_c,
-//                                 arma::uword *err
-// )
-// {
-// 
-//   arma::uword t = time_id_dyad[dyad];
-//   double edge = y[dyad];
-//   arma::uword incr1 = rec ? 1 : N_BLK;
-//   arma::uword incr2 = rec ? N_BLK : 1;
-//   arma::uword node = node_id_dyad(dyad, rec);
-//   double *theta_temp = &theta(0, 0, dyad);
-//   double *te;
-// 
-// 
-//   double total = 0.0, res;
-//   for(arma::uword g = 0; g < N_BLK; ++g, theta_temp+=incr1){
-//     new_c[g] -= phi[g];
-//     res = 0.0;
-//     for(arma::uword m = 0; m < N_STATE; ++m){
-//       // Rprintf("kappa = %f, alpha = %f, new_c = %f, phi = %f\n", kappa_t(m, t),
-//       //         alpha(g, node, m), new_c[g], phi[g]);
-//       res += kappa_t(m, t) * log(alpha(g, node, m) + std::max(new_c[g], 0.0));
-//     }
-//     //Rprintf("res before = %f\n",res);
-//     te = theta_temp;
-//     for(arma::uword h = 0; h < N_BLK; ++h, te+=incr2){
-//       //Rprintf("theta = %f, phi_o = %f\n",*te, phi_o[h]);
-//       res += phi_o[h] * (edge * log(*te) + (1.0 - edge) * log(1.0 - *te));
-//     }
-//     //Rprintf("res after = %f\n",res);
-//     phi[g] = exp(res);
-//     if(!std::isfinite(phi[g])){
-//       (*err)++;
-//     }
-//     total += phi[g];
-//   }
-// 
-//   //Normalize phi to sum to 1
-//   //and store new value in c
-//   for(arma::uword g = 0; g < N_BLK; ++g){
-//     phi[g] /= total;
-//     new_c[g] += phi[g];
-//   }
-// }
-// 
-// 
-// void MMModel::updatePhi()
-// {
-//   //Rcpp::Rcout << arma::mean(arma::sum(old_e)) << std::endl;
-//   arma::uword err = 0;
-//   // Update dyads with sampled nodes
-//   for(arma::uword d = 0; d < N_DYAD; ++d){
-//     Rcpp::checkUserInterrupt();
-//       if(node_est[node_id_dyad(d, 0)]) {
-//         updatePhiInternal(d,
-//                           0,
-//                           &(send_phi(0, d)),
-//                           &(rec_phi(0, d)),
-//                           &(e_c_t(0, node_id_dyad(d, 0))),
-//                           &err
-//         );
-//       }
-//       if(node_est[node_id_dyad(d, 1)]) {
-//         updatePhiInternal(d,
-//                           1,
-//                           &(rec_phi(0, d)),
-//                           &(send_phi(0, d)),
-//                           &(e_c_t(0, node_id_dyad(d, 1))),
-//                           &err
-//         );
-//       }
-//   }
-//   //Rcpp::stop("stop here.");
-// 
-// 
-//   if(err){
-//     Rcpp::stop("Phi value became NaN.");
-//   }
-// 
-// }
-
-
+// Updates the variational membership of one side of a dyad.
+// old_c holds the node's counts at the start of the sweep (including
+// the dyad's own contribution), and the change in phi is added to
+// delta_c. In a serial sweep both point to the node's column in e_c_t,
+// which recovers the usual in-place collapsed update. In a threaded
+// sweep delta_c points to the thread's slice of new_e_c_t.
 void MMModel::updatePhiInternal(arma::uword dyad,
                                 arma::uword rec,
-                                double *phi,
-                                double *phi_o,
-                                double *new_c,
+                                phi_type *phi,
+                                const phi_type *phi_o,
+                                const double *old_c,
+                                double *delta_c,
+                                double *phi_new,
                                 arma::uword *err
 )
 {
@@ -696,88 +868,121 @@ void MMModel::updatePhiInternal(arma::uword dyad,
   arma::uword incr1 = rec ? 1 : N_BLK;
   arma::uword incr2 = rec ? N_BLK : 1;
   arma::uword node = node_id_dyad(dyad, rec);
-  double *theta_temp = &theta(0, 0, dyad);
-  double *te;
-  double total = 0.0, old_val =0.0, res;
-  for(arma::uword g = 0; g < N_BLK; ++g, theta_temp+=incr1){
-    old_val =  phi[g];
-    new_c[g] -= phi[g];
+  double linpred = dyad_linpred[dyad];
+  const double *b_temp = b_t.memptr();
+  const double *be;
+  double total = 0.0, old_val = 0.0, res, eta_val;
+  for(arma::uword g = 0; g < N_BLK; ++g, b_temp+=incr1){
+    old_val = phi[g];
     res = 0.0;
     for(arma::uword m = 0; m < N_STATE; ++m){
-      res += kappa_t(m, t) * log(alpha(g, node, m) + std::max(new_c[g], 0.0));
+      res += kappa_t(m, t) * log(alpha(g, node, m) + std::max(old_c[g] - old_val, 0.0));
     }
+    delta_c[g] -= old_val;
 
-    te = theta_temp;
-    for(arma::uword h = 0; h < N_BLK; ++h, te+=incr2){
-      res += phi_o[h] * (edge * log(*te) + (1.0 - edge) * log(1.0 - *te));
+    be = b_temp;
+    for(arma::uword h = 0; h < N_BLK; ++h, be+=incr2){
+      // edge * log(theta) + (1 - edge) * log(1 - theta)
+      eta_val = *be + linpred;
+      res += phi_o[h] * (edge * eta_val - log1pExp(eta_val));
     }
-    phi[g] = exp(res);
-    if(!std::isfinite(phi[g])){
-      // #ifdef _OPENMP
-      // #pragma omp atomic
-      // #endif
-      phi[g] = old_val + R::runif(0,1);
-      //(*err)++;
+    phi_new[g] = exp(res);
+    if(!std::isfinite(phi_new[g])){
+      // R's RNG cannot be called from worker threads,
+      // so keep the previous value instead of jittering it.
+      phi_new[g] = old_val;
+      (*err)++;
     }
-    total += phi[g];
+    total += phi_new[g];
   }
 
   //Normalize phi to sum to 1
   //and store new value in c
   for(arma::uword g = 0; g < N_BLK; ++g){
-    phi[g] /= total;
-    new_c[g] += phi[g];
+    phi[g] = phi_new[g] / total;
+    delta_c[g] += phi[g];
   }
 }
 
 
 void MMModel::updatePhi()
 {
-  // for(int thread = 0; thread < N_THREAD; ++thread){
-  //   std::fill(new_e_c_t[thread].begin(), new_e_c_t[thread].end(), 0.0);
-  // }
-  arma::uword err = 0;
-  // #ifdef _OPENMP
-  // #pragma omp parallel for
-  // #endif
-  for(arma::uword d = 0; d < N_DYAD; ++d){
-    Rcpp::checkUserInterrupt();
-
-    // int thread = 0;
-    // #ifdef _OPENMP
-    //     thread = omp_get_thread_num();
-    // #endif
-          if(node_est[node_id_dyad(d, 0)]) {
-            updatePhiInternal(d,
-                              0,
-                              &(send_phi(0, d)),
-                              &(rec_phi(0, d)),
-                              &(e_c_t(0, node_id_dyad(d, 0))),
-                              &err
-            );
-          }
-   
-   if(node_est[node_id_dyad(d, 1)]) {
-             updatePhiInternal(d,
-                               1,
-                               &(rec_phi(0, d)),
-                               &(send_phi(0, d)),
-                               &(e_c_t(0, node_id_dyad(d, 1))),
-                               &err
-             );
-           }
+  Rcpp::checkUserInterrupt();
+  // Only dyads in the current batch are visited (all of
+  // them, unless stochastic VI is used). Their edge
+  // log-odds may be stale if they were not in the
+  // batch used by the last M-step; the same holds for alpha.
+  computeTheta();
+  computeAlpha();
+  arma::uword err = 0, N_BATCH = dyad_batch.n_elem;
+  bool threaded = N_THREAD > 1;
+  if(threaded){
+    new_e_c_t.zeros();
   }
-
-  if(err){
-    Rcpp::stop("Phi value became NaN.");
+  // With more than one thread, e_c_t is read-only during the sweep
+  // and each thread accumulates its count deltas in its own slice of
+  // new_e_c_t. These are merged in thread order once the sweep is done.
+#pragma omp parallel for schedule(static) reduction(+: err) if(threaded)
+  for(arma::uword i = 0; i < N_BATCH; ++i){
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    arma::uword d = dyad_batch[i];
+    arma::uword p = node_id_dyad(d, 0), q = node_id_dyad(d, 1);
+    if(node_est[p]) {
+      updatePhiInternal(d,
+                        0,
+                        &(send_phi(0, d)),
+                        &(rec_phi(0, d)),
+                        &(e_c_t(0, p)),
+                        threaded ? &(new_e_c_t(0, p, thread)) : &(e_c_t(0, p)),
+                        phi_scratch.colptr(thread),
+                        &err
+      );
+    }
+    if(node_est[q]) {
+      updatePhiInternal(d,
+                        1,
+                        &(rec_phi(0, d)),
+                        &(send_phi(0, d)),
+                        &(e_c_t(0, q)),
+                        threaded ? &(new_e_c_t(0, q, thread)) : &(e_c_t(0, q)),
+                        phi_scratch.colptr(thread),
+                        &err
+      );
+    }
+  }
+  
+  if(threaded){
+    for(arma::uword thread = 0; thread < new_e_c_t.n_slices; ++thread){
+      e_c_t += new_e_c_t.slice(thread);
+    }
   }
 
+  n_phi_fallback = err;
+
 }
 
 
 
 void MMModel::sampleDyads(arma::uword iter)
 {
+  // Clear flags set by the previous batch
+  // (the initial batch contains everything)
+  if(first_batch){
+    node_in_batch.zeros();
+    dyad_in_batch.zeros();
+    first_batch = false;
+  } else {
+    for(arma::uword i = 0; i < dyad_batch.n_elem; ++i){
+      dyad_in_batch[dyad_batch[i]] = 0;
+    }
+    for(arma::uword i = 0; i < node_batch.n_elem; ++i){
+      node_in_batch[node_batch[i]] = 0;
+    }
+  }
+  
   // Sample nodes for stochastic variational update
   if(N_TIME < 2){
     node_batch = arma::randperm(N_NODE, n_nodes_batch[0]);
@@ -793,19 +998,90 @@ void MMModel::sampleDyads(arma::uword iter)
     }
   }
   
-  for(arma::uword p = 0; p < N_NODE; ++p){
-    node_in_batch[p] = arma::any(node_batch == p) ? 1 : 0;
+  // Mark sampled nodes and collect their dyads by walking the
+  // node-to-dyad index, so the cost is the sum of the sampled
+  // nodes' degrees.
+  arma::uword p, n_batch = 0, max_batch = 0;
+  for(arma::uword i = 0; i < N_NODE_BATCH; ++i){
+    p = node_batch[i];
+    node_in_batch[p] = 1;
+    max_batch += tot_nodes[p];
   }
-  
-  for(arma::uword d = 0; d < N_DYAD; ++d){
-    dyad_in_batch[d] = (arma::any(node_batch == node_id_dyad(d, 0)) 
-                          | arma::any(node_batch == node_id_dyad(d, 1))) ? 1 : 0;
+  dyad_batch.set_size(max_batch);
+  for(arma::uword i = 0; i < N_NODE_BATCH; ++i){
+    p = node_batch[i];
+    for(arma::uword j = node_dyad_ptr[p]; j < node_dyad_ptr[p + 1]; ++j){
+      if(dyad_in_batch[node_dyad_ind[j]] == 0){
+        dyad_in_batch[node_dyad_ind[j]] = 1;
+        dyad_batch[n_batch++] = node_dyad_ind[j];
+      }
+    }
   }
-  
-  reweightFactor = (1. * N_DYAD) / arma::sum(dyad_in_batch);
+  dyad_batch.resize(n_batch);
+  std::sort(dyad_batch.begin(), dyad_batch.end());
+  reweightFactor = (1. * N_DYAD) / dyad_batch.n_elem;
   step_size = 1.0 / pow(delay + iter, forget_rate);
 }
 
+/**
+ DYAD ORDERING
+ */
+
+// Dyads sorted by sender, then receiver, so that node-level
+// state stays in cache while sweeping over dyads.
+arma::uvec MMModel::dyadOrder(const arma::umat& node_id_dyad, bool reorder)
+{
+  arma::uvec ord(node_id_dyad.n_rows);
+  std::iota(ord.begin(), ord.end(), 0);
+  if(reorder){
+    std::stable_sort(ord.begin(), ord.end(),
+                     [&node_id_dyad](arma::uword a, arma::uword b){
+                       return (node_id_dyad(a, 0) < node_id_dyad(b, 0))
+                       || ((node_id_dyad(a, 0) == node_id_dyad(b, 0))
+                             && (node_id_dyad(a, 1) < node_id_dyad(b, 1)));
+                     });
+  }
+  return ord;
+}
+
+/**
+ CHECKPOINTING
+ */
+
+// Variational state needed to continue a fit; everything
+// else (alpha, b_t, batches) is recomputed from it.
+void MMModel::saveState(std::ostream& out)
+{
+  writeBlock(out, dyad_order.memptr(), dyad_order.n_elem);
+  writeBlock(out, send_phi.memptr(), send_phi.n_elem);
+  writeBlock(out, rec_phi.memptr(), rec_phi.n_elem);
+  writeBlock(out, e_c_t.memptr(), e_c_t.n_elem);
+  writeBlock(out, kappa_t.memptr(), kappa_t.n_elem);
+  writeBlock(out, e_wmn_t.memptr(), e_wmn_t.n_elem);
+  writeBlock(out, e_wm.memptr(), e_wm.n_elem);
+  writeBlock(out, beta.memptr(), beta.n_elem);
+  writeBlock(out, theta_par.memptr(), theta_par.n_elem);
+}
+
+void MMModel::loadState(std::istream& in)
+{
+  arma::uvec saved_order(N_DYAD);
+  readBlock(in, saved_order.memptr(), N_DYAD);
+  if(!std::equal(saved_order.begin(), saved_order.end(), dyad_order.begin())){
+    Rcpp::stop("Checkpoint was created with a different dyad ordering.");
+  }
+  readBlock(in, send_phi.memptr(), send_phi.n_elem);
+  readBlock(in, rec_phi.memptr(), rec_phi.n_elem);
+  readBlock(in, e_c_t.memptr(), e_c_t.n_elem);
+  readBlock(in, kappa_t.memptr(), kappa_t.n_elem);
+  readBlock(in, e_wmn_t.memptr(), e_wmn_t.n_elem);
+  readBlock(in, e_wm.memptr(), e_wm.n_elem);
+  readBlock(in, beta.memptr(), beta.n_elem);
+  readBlock(in, theta_par.memptr(), theta_par.n_elem);
+  computeTheta(true);
+  computeAlpha(true);
+}
+
 /**
  * CONVERGENCE CHECKER
  */
@@ -936,6 +1212,14 @@ arma::vec MMModel::getPostMM(arma::uword p)
 arma::mat MMModel::getPostMM()
 {
   arma::mat res(N_BLK, N_NODE);
+  getPostMM(res);
+  return res;
+}
+
+// Output getters taking a matrix write into its memory,
+// which may be owned by R.
+void MMModel::getPostMM(arma::mat& res)
+{
   arma::vec e_alpha(N_BLK);
   double row_total;
   for(arma::uword p = 0; p < N_NODE; ++p){
@@ -955,7 +1239,6 @@ arma::mat MMModel::getPostMM()
       res.col(p) = e_c_t.col(p)/arma::sum(e_c_t.col(p));
     }
   }
-  return res;
 }
 
 arma::mat MMModel::getC()
@@ -963,13 +1246,29 @@ arma::mat MMModel::getC()
   return e_c_t.t();
 }
 
+void MMModel::getC(arma::mat& res)
+{
+  for(arma::uword p = 0; p < N_NODE; ++p){
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      res(p, g) = e_c_t(g, p);
+    }
+  }
+}
+
 
 arma::mat MMModel::getPhi(bool send)
 {
-  if(send){
-    return(send_phi);
-  } else {
-    return(rec_phi);
+  arma::mat res(N_BLK, N_DYAD);
+  getPhi(send, res);
+  return res;
+}
+
+void MMModel::getPhi(bool send, arma::mat& res)
+{
+  // Columns in original dyad order
+  const phi_mat& phi = send ? send_phi : rec_phi;
+  for(arma::uword d = 0; d < N_DYAD; ++d){
+    std::copy(phi.colptr(d), phi.colptr(d) + N_BLK, res.colptr(dyad_order[d]));
   }
 }
 
@@ -994,6 +1293,32 @@ arma::mat MMModel::getKappa()
 }
 
 
+arma::uword MMModel::getNDyadBatch()
+{
+  return dyad_batch.n_elem;
+}
+
+arma::uword MMModel::getPhiFallbacks()
+{
+  return n_phi_fallback;
+}
+
+double MMModel::getStepSize()
+{
+  return step_size;
+}
+
+// Function and gradient evaluations, and failure flag,
+// of the last optimization of alpha (or theta) parameters
+arma::ivec MMModel::getOptimCounts(bool alpha)
+{
+  arma::ivec res(3);
+  res[0] = alpha ? fncountAlpha : fncountTheta;
+  res[1] = alpha ? grcountAlpha : grcountTheta;
+  res[2] = alpha ? m_failAlpha : m_failTheta;
+  return res;
+}
+
 arma::mat MMModel::getWmn()
 {
   arma::mat res(N_STATE, N_STATE);
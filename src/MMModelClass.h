@@ -2,6 +2,9 @@
 #define MMMODEL_CLASS
 
 #include <vector>
+#include <limits>
+#include <numeric>
+#include <algorithm>
 
 // #ifndef DEBUG_MODE
 // #define DEBUG_MODE
@@ -10,24 +13,40 @@
 
 #include <RcppArmadillo.h>
 #include "AuxFuns.h"
+#include "MappedBuffer.h"
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+// Storage of dyad-level arrays. Compiling with -DNETMIX_COMPACT
+// (e.g. NETMIX_CPPFLAGS=-DNETMIX_COMPACT R CMD INSTALL) stores phi
+// in single precision and dyad indices in 32 bits; counts and
+// bounds are still accumulated in double precision.
+#ifdef NETMIX_COMPACT
+typedef float phi_type;
+typedef arma::u32 dyad_uword;
+#else
+typedef double phi_type;
+typedef arma::uword dyad_uword;
+#endif
+typedef arma::Mat<phi_type> phi_mat;
+typedef arma::Col<dyad_uword> dyad_uvec;
+typedef arma::Mat<dyad_uword> dyad_umat;
+
 
 
 class MMModel
 {
 public:
-  MMModel(const arma::mat& z_t,
+  MMModel(const arma::mat& z_t_in,
           //const arma::mat& z_t_ho,
-          const arma::mat& x_t,
-          const arma::vec& y,
+          const arma::mat& x_t_in,
+          const arma::vec& y_in,
           //const arma::vec& y_ho,
-          const arma::uvec& time_id_dyad,
+          const arma::uvec& time_id_dyad_in,
           const arma::uvec& time_id_node,
           const arma::uvec& nodes_per_period,
-          const arma::umat& node_id_dyad,
+          const arma::umat& node_id_dyad_in,
           //const arma::umat& node_id_dyad_ho,
           const arma::field<arma::uvec>& node_id_period,
           const arma::mat& mu_b,
@@ -53,14 +72,23 @@ public:
   void optim_ours(bool);
   double LL();
   double LB();
+  void saveState(std::ostream&);
+  void loadState(std::istream&);
   //double llho();
   
   
   arma::mat getPostMM();
+  void getPostMM(arma::mat&);
   arma::vec getPostMM(arma::uword);
   arma::mat getC();
+  void getC(arma::mat&);
   arma::mat getPhi(bool);
+  void getPhi(bool, arma::mat&);
   arma::uvec getN();
+  arma::uword getNDyadBatch();
+  arma::uword getPhiFallbacks();
+  double getStepSize();
+  arma::ivec getOptimCounts(bool);
   arma::mat getWmn();
   arma::mat getKappa();
   arma::mat getB();
@@ -92,7 +120,8 @@ private:
   N_B_PAR,
   OPT_ITER,
   N_NODE_BATCH,
-  N_THREAD;
+  N_THREAD,
+  LBFGS_MEM; //0 for dense BFGS
   //N_DYAD_HO;
   
   const double eta,
@@ -117,23 +146,33 @@ private:
   grcountTheta,
   m_failAlpha,
   m_failTheta;
+  arma::uword n_phi_fallback; //Non-finite phi values replaced in last updatePhi()
   
   
   bool verbose,
   directed;
   
+  const bool copy_dyads; //Hold own copy of y and z_t in internal dyad order (if reordered);
+                         //otherwise, y, z_t and x_t alias the caller's memory
+  const arma::uvec dyad_order; //Original index of each (internally reordered) dyad
+  
+  const arma::vec y_own; //Storage of y when copy_dyads is true
   const arma::vec y;// y_ho;
   
-  const arma::uvec time_id_dyad,
-  time_id_node,
+  const dyad_uvec time_id_dyad;
+  
+  const arma::uvec time_id_node,
   n_nodes_time,
   n_nodes_batch,
   node_est;
   
   arma::uvec tot_nodes,
-  node_in_batch,
-  dyad_in_batch,
-  node_batch;
+  node_in_batch;
+  dyad_uvec dyad_in_batch;
+  arma::uvec node_batch;
+  dyad_uvec dyad_batch;
+  arma::uvec node_dyad_ptr; //CSR index of dyads incident
+  dyad_uvec node_dyad_ind;  //on each node
   
   std::vector<int> maskalpha,
   masktheta;
@@ -144,11 +183,23 @@ private:
   e_wm,
   alpha_gr, theta_gr,
   gamma,
-  gamma_init;
+  gamma_init,
+  dyad_linpred, //z_t.col(d)'gamma; edge prob. for blocks (g,h) is logistic(b_t(h,g) + dyad_linpred[d])
+  theta_off_par, //Second-order expansion around theta_off_par of the
+  theta_off_gr;  //theta bound of dyads in fixed periods (see fixed_times)
+  arma::mat theta_off_hess;
+  double theta_off_val;
+  bool fixed_dyads;
+  bool first_batch; //sampleDyads has not been called yet
   
-  const arma::umat node_id_dyad;// node_id_dyad_ho; //matrix (column major)
+  const dyad_umat node_id_dyad;// node_id_dyad_ho; //matrix (column major)
   arma::umat par_ind;
   
+  const std::string ooc_dir;
+  MappedBuffer z_buf, //Storage of dyad-level arrays (file-backed
+  send_phi_buf,       //if ooc_dir is not empty)
+  rec_phi_buf;
+  
   const arma::mat x_t, //matrix (column major)
   z_t,
   //z_t_ho,
@@ -157,19 +208,20 @@ private:
   
   arma::mat kappa_t,
   b_t,
-  alpha_term,
-  send_phi,
-  rec_phi,
-  e_wmn_t,
-  e_c_t;
+  alpha_term;
+  
+  phi_mat send_phi,
+  rec_phi;
+  
+  arma::mat e_wmn_t,
+  e_c_t,
+  theta_gr_thread, //Per-thread theta gradients (for reduce op.)
+  phi_scratch; //Per-thread unnormalized phi
   
   arma::cube alpha, //3d array (column major)
-  theta,
   beta, betaold,
-  beta_init;
-  
-  //std::vector< Array<double> > new_e_c_t; //For reduce op.
-  //arma::mat new_e_c_t;
+  beta_init,
+  new_e_c_t; //Per-thread count deltas (for reduce op.)
   
   arma::cube::iterator beta_end;
   arma::vec::iterator theta_par_end;
@@ -179,16 +231,23 @@ private:
   void computeTheta(bool = false);
   double alphaLB(bool = false);
   static double alphaLBW(int, double*, void*);
-  void alphaGr(int, double*);
+  double alphaGr(int, double*, bool = true);
   static void alphaGrW(int, double*, double*, void*);
+  static double alphaLBGrW(int, double*, double*, void*);
   double thetaLB(bool = false, bool = false);
   static double thetaLBW(int, double*, void*);
-  void thetaGr(int, double*);
+  double thetaGr(int, double*, bool = true);
   static void thetaGrW(int, double*, double*, void*);
+  static double thetaLBGrW(int, double*, double*, void*);
+  void computeThetaOffset(const dyad_uvec&);
+  double thetaOffset(double*);
 
+  static arma::uvec dyadOrder(const arma::umat&, bool);
   void updatePhiInternal(arma::uword, arma::uword,
+                         phi_type*,
+                         const phi_type*,
+                         const double*,
                          double*,
-                         double* ,
                          double*,
                          arma::uword* );
   
@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <vector>
+#include <RcppArmadillo.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+#include "MappedBuffer.h"
+
+MappedBuffer::MappedBuffer(std::size_t n_bytes_in,
+                           const std::string& dir,
+                           bool sequential)
+  : data(NULL),
+    n_bytes(n_bytes_in > 0 ? n_bytes_in : 1),
+    mapped(false)
+{
+#ifndef _WIN32
+  if(!dir.empty()){
+    std::string path = dir + "/netmix_XXXXXX";
+    std::vector<char> path_tmpl(path.begin(), path.end());
+    path_tmpl.push_back('\0');
+    int fd = mkstemp(&path_tmpl[0]);
+    if(fd < 0){
+      Rcpp::stop("Cannot create temporary file in ooc_dir.");
+    }
+    // File is removed once it is unmapped
+    unlink(&path_tmpl[0]);
+    if(ftruncate(fd, n_bytes) != 0){
+      close(fd);
+      Rcpp::stop("Cannot allocate temporary file in ooc_dir.");
+    }
+    data = mmap(NULL, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED){
+      data = NULL;
+      Rcpp::stop("Cannot map temporary file in ooc_dir.");
+    }
+    mapped = true;
+    // Read ahead only helps when all dyads are visited in
+    // increasing order; stochastic batches are scattered
+    madvise(data, n_bytes, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+  }
+#endif
+  if(!mapped){
+    data = std::calloc(n_bytes, 1);
+    if(data == NULL){
+      Rcpp::stop("Cannot allocate memory for dyad-level arrays.");
+    }
+  }
+}
+
+MappedBuffer::~MappedBuffer()
+{
+#ifndef _WIN32
+  if(mapped){
+    munmap(data, n_bytes);
+    return;
+  }
+#endif
+  std::free(data);
+}
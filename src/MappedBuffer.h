@@ -0,0 +1,40 @@
+#ifndef MAPPED_BUFFER_HPP
+#define MAPPED_BUFFER_HPP
+
+#include <string>
+#include <cstddef>
+
+// Zero-initialized storage for large dyad-level arrays. If dir is
+// not empty, memory is backed by an (unlinked) temporary file in dir,
+// so that pages can be written back to disk rather than to swap.
+// Otherwise (and on Windows), memory is allocated on the heap.
+// sequential tells the kernel whether the mapped pages are read in
+// order (full sweeps) or scattered (batches of stochastic VI).
+class MappedBuffer
+{
+public:
+  MappedBuffer(std::size_t n_bytes,
+               const std::string& dir,
+               bool sequential = true);
+  ~MappedBuffer();
+  
+  template<typename T>
+  T* ptr()
+  {
+    return static_cast<T*>(data);
+  }
+  bool isMapped() const
+  {
+    return mapped;
+  }
+  
+private:
+  MappedBuffer(const MappedBuffer&);
+  MappedBuffer& operator=(const MappedBuffer&);
+  
+  void* data;
+  std::size_t n_bytes;
+  bool mapped;
+};
+
+#endif // MAPPED_BUFFER_HPP
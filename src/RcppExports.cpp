@@ -7,8 +7,8 @@
 using namespace Rcpp;
 
 // approxB
-Rcpp::NumericMatrix approxB(Rcpp::NumericVector y, Rcpp::IntegerMatrix d_id, Rcpp::NumericMatrix pi_mat, bool directed);
-RcppExport SEXP _NetMix_approxB(SEXP ySEXP, SEXP d_idSEXP, SEXP pi_matSEXP, SEXP directedSEXP) {
+Rcpp::NumericMatrix approxB(Rcpp::NumericVector y, Rcpp::IntegerMatrix d_id, Rcpp::NumericMatrix pi_mat, bool directed, int threads);
+RcppExport SEXP _NetMix_approxB(SEXP ySEXP, SEXP d_idSEXP, SEXP pi_matSEXP, SEXP directedSEXP, SEXP threadsSEXP) {
 BEGIN_RCPP
     Rcpp::RObject rcpp_result_gen;
     Rcpp::RNGScope rcpp_rngScope_gen;
@@ -16,7 +16,8 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< Rcpp::IntegerMatrix >::type d_id(d_idSEXP);
     Rcpp::traits::input_parameter< Rcpp::NumericMatrix >::type pi_mat(pi_matSEXP);
     Rcpp::traits::input_parameter< bool >::type directed(directedSEXP);
-    rcpp_result_gen = Rcpp::wrap(approxB(y, d_id, pi_mat, directed));
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(approxB(y, d_id, pi_mat, directed, threads));
     return rcpp_result_gen;
 END_RCPP
 }
@@ -67,6 +68,164 @@ BEGIN_RCPP
     return rcpp_result_gen;
 END_RCPP
 }
+// alphaHess
+arma::mat alphaHess(arma::vec par, arma::uvec tot_nodes, arma::umat c_t, arma::mat x_t, arma::umat s_mat, arma::uvec t_id, arma::cube var_beta, arma::cube mu_beta);
+RcppExport SEXP _NetMix_alphaHess(SEXP parSEXP, SEXP tot_nodesSEXP, SEXP c_tSEXP, SEXP x_tSEXP, SEXP s_matSEXP, SEXP t_idSEXP, SEXP var_betaSEXP, SEXP mu_betaSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< arma::vec >::type par(parSEXP);
+    Rcpp::traits::input_parameter< arma::uvec >::type tot_nodes(tot_nodesSEXP);
+    Rcpp::traits::input_parameter< arma::umat >::type c_t(c_tSEXP);
+    Rcpp::traits::input_parameter< arma::mat >::type x_t(x_tSEXP);
+    Rcpp::traits::input_parameter< arma::umat >::type s_mat(s_matSEXP);
+    Rcpp::traits::input_parameter< arma::uvec >::type t_id(t_idSEXP);
+    Rcpp::traits::input_parameter< arma::cube >::type var_beta(var_betaSEXP);
+    Rcpp::traits::input_parameter< arma::cube >::type mu_beta(mu_betaSEXP);
+    rcpp_result_gen = Rcpp::wrap(alphaHess(par, tot_nodes, c_t, x_t, s_mat, t_id, var_beta, mu_beta));
+    return rcpp_result_gen;
+END_RCPP
+}
+// vcovBetaSim
+arma::mat vcovBetaSim(const arma::vec& par, const arma::mat& send_phi, const arma::mat& rec_phi, const arma::umat& d_id, const arma::uvec& tot_nodes, const arma::mat& x_t, const arma::mat& kappa, const arma::uvec& t_id, const arma::cube& var_beta, int nsim, int threads);
+RcppExport SEXP _NetMix_vcovBetaSim(SEXP parSEXP, SEXP send_phiSEXP, SEXP rec_phiSEXP, SEXP d_idSEXP, SEXP tot_nodesSEXP, SEXP x_tSEXP, SEXP kappaSEXP, SEXP t_idSEXP, SEXP var_betaSEXP, SEXP nsimSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::vec& >::type par(parSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type send_phi(send_phiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type rec_phi(rec_phiSEXP);
+    Rcpp::traits::input_parameter< const arma::umat& >::type d_id(d_idSEXP);
+    Rcpp::traits::input_parameter< const arma::uvec& >::type tot_nodes(tot_nodesSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type x_t(x_tSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type kappa(kappaSEXP);
+    Rcpp::traits::input_parameter< const arma::uvec& >::type t_id(t_idSEXP);
+    Rcpp::traits::input_parameter< const arma::cube& >::type var_beta(var_betaSEXP);
+    Rcpp::traits::input_parameter< int >::type nsim(nsimSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(vcovBetaSim(par, send_phi, rec_phi, d_id, tot_nodes, x_t, kappa, t_id, var_beta, nsim, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// vcovThetaSim
+arma::mat vcovThetaSim(const arma::mat& send_phi, const arma::mat& rec_phi, const arma::mat& z_t, const arma::umat& par_ind, const arma::vec& theta, const arma::vec& lambda, const arma::umat& samp_ind, int threads);
+RcppExport SEXP _NetMix_vcovThetaSim(SEXP send_phiSEXP, SEXP rec_phiSEXP, SEXP z_tSEXP, SEXP par_indSEXP, SEXP thetaSEXP, SEXP lambdaSEXP, SEXP samp_indSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type send_phi(send_phiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type rec_phi(rec_phiSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type z_t(z_tSEXP);
+    Rcpp::traits::input_parameter< const arma::umat& >::type par_ind(par_indSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type theta(thetaSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type lambda(lambdaSEXP);
+    Rcpp::traits::input_parameter< const arma::umat& >::type samp_ind(samp_indSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(vcovThetaSim(send_phi, rec_phi, z_t, par_ind, theta, lambda, samp_ind, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// simulateNet
+Rcpp::List simulateNet(const arma::cube& alpha, const arma::mat& kappa, const arma::uvec& t_id_node, const arma::umat& d_id, const arma::mat& block_model, const arma::vec& dyad_linpred, int nsim, int threads);
+RcppExport SEXP _NetMix_simulateNet(SEXP alphaSEXP, SEXP kappaSEXP, SEXP t_id_nodeSEXP, SEXP d_idSEXP, SEXP block_modelSEXP, SEXP dyad_linpredSEXP, SEXP nsimSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::cube& >::type alpha(alphaSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type kappa(kappaSEXP);
+    Rcpp::traits::input_parameter< const arma::uvec& >::type t_id_node(t_id_nodeSEXP);
+    Rcpp::traits::input_parameter< const arma::umat& >::type d_id(d_idSEXP);
+    Rcpp::traits::input_parameter< const arma::mat& >::type block_model(block_modelSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type dyad_linpred(dyad_linpredSEXP);
+    Rcpp::traits::input_parameter< int >::type nsim(nsimSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(simulateNet(alpha, kappa, t_id_node, d_id, block_model, dyad_linpred, nsim, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// gofStats
+Rcpp::List gofStats(Rcpp::List nets, Rcpp::CharacterVector gof_stat, bool directed, int geo_sources, int threads);
+RcppExport SEXP _NetMix_gofStats(SEXP netsSEXP, SEXP gof_statSEXP, SEXP directedSEXP, SEXP geo_sourcesSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< Rcpp::List >::type nets(netsSEXP);
+    Rcpp::traits::input_parameter< Rcpp::CharacterVector >::type gof_stat(gof_statSEXP);
+    Rcpp::traits::input_parameter< bool >::type directed(directedSEXP);
+    Rcpp::traits::input_parameter< int >::type geo_sources(geo_sourcesSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(gofStats(nets, gof_stat, directed, geo_sources, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// socioCSR
+Rcpp::List socioCSR(const arma::umat& d_id, const arma::vec& y, int n_node, bool directed, bool impute);
+RcppExport SEXP _NetMix_socioCSR(SEXP d_idSEXP, SEXP ySEXP, SEXP n_nodeSEXP, SEXP directedSEXP, SEXP imputeSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::umat& >::type d_id(d_idSEXP);
+    Rcpp::traits::input_parameter< const arma::vec& >::type y(ySEXP);
+    Rcpp::traits::input_parameter< int >::type n_node(n_nodeSEXP);
+    Rcpp::traits::input_parameter< bool >::type directed(directedSEXP);
+    Rcpp::traits::input_parameter< bool >::type impute(imputeSEXP);
+    rcpp_result_gen = Rcpp::wrap(socioCSR(d_id, y, n_node, directed, impute));
+    return rcpp_result_gen;
+END_RCPP
+}
+// spectralEmbed
+Rcpp::List spectralEmbed(int n_node, const arma::umat& edges, bool directed, int n_elem, int iter, int threads);
+RcppExport SEXP _NetMix_spectralEmbed(SEXP n_nodeSEXP, SEXP edgesSEXP, SEXP directedSEXP, SEXP n_elemSEXP, SEXP iterSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n_node(n_nodeSEXP);
+    Rcpp::traits::input_parameter< const arma::umat& >::type edges(edgesSEXP);
+    Rcpp::traits::input_parameter< bool >::type directed(directedSEXP);
+    Rcpp::traits::input_parameter< int >::type n_elem(n_elemSEXP);
+    Rcpp::traits::input_parameter< int >::type iter(iterSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(spectralEmbed(n_node, edges, directed, n_elem, iter, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// kmeansPP
+Rcpp::IntegerVector kmeansPP(const arma::mat& x, int centers, int iter_max, int nstart, int threads);
+RcppExport SEXP _NetMix_kmeansPP(SEXP xSEXP, SEXP centersSEXP, SEXP iter_maxSEXP, SEXP nstartSEXP, SEXP threadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< const arma::mat& >::type x(xSEXP);
+    Rcpp::traits::input_parameter< int >::type centers(centersSEXP);
+    Rcpp::traits::input_parameter< int >::type iter_max(iter_maxSEXP);
+    Rcpp::traits::input_parameter< int >::type nstart(nstartSEXP);
+    Rcpp::traits::input_parameter< int >::type threads(threadsSEXP);
+    rcpp_result_gen = Rcpp::wrap(kmeansPP(x, centers, iter_max, nstart, threads));
+    return rcpp_result_gen;
+END_RCPP
+}
+// mmsbm_benchmark
+Rcpp::DataFrame mmsbm_benchmark(int n_nodes, int n_blocks, int n_states, int n_periods, int n_monad_pred, int n_dyad_pred, int dyads_per_node, double density, Rcpp::IntegerVector threads, int iter, double batch_size, bool directed);
+RcppExport SEXP _NetMix_mmsbm_benchmark(SEXP n_nodesSEXP, SEXP n_blocksSEXP, SEXP n_statesSEXP, SEXP n_periodsSEXP, SEXP n_monad_predSEXP, SEXP n_dyad_predSEXP, SEXP dyads_per_nodeSEXP, SEXP densitySEXP, SEXP threadsSEXP, SEXP iterSEXP, SEXP batch_sizeSEXP, SEXP directedSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject rcpp_result_gen;
+    Rcpp::RNGScope rcpp_rngScope_gen;
+    Rcpp::traits::input_parameter< int >::type n_nodes(n_nodesSEXP);
+    Rcpp::traits::input_parameter< int >::type n_blocks(n_blocksSEXP);
+    Rcpp::traits::input_parameter< int >::type n_states(n_statesSEXP);
+    Rcpp::traits::input_parameter< int >::type n_periods(n_periodsSEXP);
+    Rcpp::traits::input_parameter< int >::type n_monad_pred(n_monad_predSEXP);
+    Rcpp::traits::input_parameter< int >::type n_dyad_pred(n_dyad_predSEXP);
+    Rcpp::traits::input_parameter< int >::type dyads_per_node(dyads_per_nodeSEXP);
+    Rcpp::traits::input_parameter< double >::type density(densitySEXP);
+    Rcpp::traits::input_parameter< Rcpp::IntegerVector >::type threads(threadsSEXP);
+    Rcpp::traits::input_parameter< int >::type iter(iterSEXP);
+    Rcpp::traits::input_parameter< double >::type batch_size(batch_sizeSEXP);
+    Rcpp::traits::input_parameter< bool >::type directed(directedSEXP);
+    rcpp_result_gen = Rcpp::wrap(mmsbm_benchmark(n_nodes, n_blocks, n_states, n_periods, n_monad_pred, n_dyad_pred, dyads_per_node, density, threads, iter, batch_size, directed));
+    return rcpp_result_gen;
+END_RCPP
+}
 // mmsbm_fit
 Rcpp::List mmsbm_fit(const arma::mat& z_t, const arma::mat& x_t, const arma::vec& y, const arma::uvec& time_id_dyad, const arma::uvec& time_id_node, const arma::uvec& nodes_per_period, const arma::umat& node_id_dyad, const arma::field<arma::uvec>& node_id_period, const arma::mat& mu_b, const arma::mat& var_b, const arma::cube& mu_beta, const arma::cube& var_beta, const arma::vec& mu_gamma, const arma::vec& var_gamma, const arma::mat& pi_init, arma::mat& kappa_init_t, arma::mat& b_init_t, arma::cube& beta_init_r, arma::vec& gamma_init_r, Rcpp::List& control);
 RcppExport SEXP _NetMix_mmsbm_fit(SEXP z_tSEXP, SEXP x_tSEXP, SEXP ySEXP, SEXP time_id_dyadSEXP, SEXP time_id_nodeSEXP, SEXP nodes_per_periodSEXP, SEXP node_id_dyadSEXP, SEXP node_id_periodSEXP, SEXP mu_bSEXP, SEXP var_bSEXP, SEXP mu_betaSEXP, SEXP var_betaSEXP, SEXP mu_gammaSEXP, SEXP var_gammaSEXP, SEXP pi_initSEXP, SEXP kappa_init_tSEXP, SEXP b_init_tSEXP, SEXP beta_init_rSEXP, SEXP gamma_init_rSEXP, SEXP controlSEXP) {
@@ -99,10 +258,19 @@ END_RCPP
 }
 
 static const R_CallMethodDef CallEntries[] = {
-    {"_NetMix_approxB", (DL_FUNC) &_NetMix_approxB, 4},
+    {"_NetMix_approxB", (DL_FUNC) &_NetMix_approxB, 5},
     {"_NetMix_getZ", (DL_FUNC) &_NetMix_getZ, 1},
     {"_NetMix_alphaLBound", (DL_FUNC) &_NetMix_alphaLBound, 8},
     {"_NetMix_alphaGrad", (DL_FUNC) &_NetMix_alphaGrad, 8},
+    {"_NetMix_alphaHess", (DL_FUNC) &_NetMix_alphaHess, 8},
+    {"_NetMix_vcovBetaSim", (DL_FUNC) &_NetMix_vcovBetaSim, 11},
+    {"_NetMix_vcovThetaSim", (DL_FUNC) &_NetMix_vcovThetaSim, 8},
+    {"_NetMix_simulateNet", (DL_FUNC) &_NetMix_simulateNet, 8},
+    {"_NetMix_gofStats", (DL_FUNC) &_NetMix_gofStats, 5},
+    {"_NetMix_socioCSR", (DL_FUNC) &_NetMix_socioCSR, 5},
+    {"_NetMix_spectralEmbed", (DL_FUNC) &_NetMix_spectralEmbed, 6},
+    {"_NetMix_kmeansPP", (DL_FUNC) &_NetMix_kmeansPP, 5},
+    {"_NetMix_mmsbm_benchmark", (DL_FUNC) &_NetMix_mmsbm_benchmark, 12},
     {"_NetMix_mmsbm_fit", (DL_FUNC) &_NetMix_mmsbm_fit, 20},
     {NULL, NULL, 0}
 };
@@ -0,0 +1,284 @@
+#include <vector>
+#include <RcppArmadillo.h>
+#include "AuxFuns.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/**
+ SPARSE PRODUCTS
+ */
+
+// res = diag(left) * A * diag(right) * x, with A the
+// binary matrix whose rows are given by adjacency a.
+void scaledMult(const Adjacency& a, const arma::vec& left, const arma::vec& right,
+                const arma::mat& x, arma::mat& res, int threads)
+{
+  const arma::uword N_NODE = a.ptr.n_elem - 1, N_COL = x.n_cols;
+  res.set_size(N_NODE, N_COL);
+#pragma omp parallel for schedule(dynamic, 256) num_threads(threads) if(threads > 1)
+  for(arma::uword i = 0; i < N_NODE; ++i){
+    for(arma::uword k = 0; k < N_COL; ++k){
+      double acc = 0.0;
+      for(arma::uword j = a.ptr[i]; j < a.ptr[i + 1]; ++j){
+        acc += right[a.ind[j]] * x(a.ind[j], k);
+      }
+      res(i, k) = left[i] * acc;
+    }
+  }
+}
+
+// Regularized Laplacian U used for spectral clustering, with
+// D = diag(1 / sqrt(degree + 1)):
+//   undirected, U = D A D (with A symmetrized);
+//   directed, U = D_out A D_in A' D_out + D_in A' D_out A D_in.
+// The in-adjacency and D_in are only built if directed.
+class Laplacian
+{
+public:
+  Laplacian(arma::uword n, const arma::umat& edges, bool directed, int threads)
+    : directed(directed),
+      threads(threads),
+      out(n, directed ? arma::uvec(edges.col(0)) : arma::uvec(arma::join_cols(edges.col(0), edges.col(1))),
+          directed ? arma::uvec(edges.col(1)) : arma::uvec(arma::join_cols(edges.col(1), edges.col(0)))),
+      in(directed ? n : 0, directed ? arma::uvec(edges.col(1)) : arma::uvec(),
+         directed ? arma::uvec(edges.col(0)) : arma::uvec()),
+      d_out(n),
+      d_in(directed ? n : 0),
+      unit(directed ? n : 0, arma::fill::ones)
+  {
+    for(arma::uword i = 0; i < n; ++i){
+      d_out[i] = 1.0 / sqrt(out.size(i) + 1.0);
+    }
+    for(arma::uword i = 0; i < d_in.n_elem; ++i){
+      d_in[i] = 1.0 / sqrt(in.size(i) + 1.0);
+    }
+  }
+
+  void mult(const arma::mat& x, arma::mat& res) const
+  {
+    if(!directed){
+      scaledMult(out, d_out, d_out, x, res, threads);
+    } else {
+      arma::mat tmp, tmp2;
+      scaledMult(in, unit, d_out, x, tmp, threads); // A' D_out x
+      scaledMult(out, d_out, d_in, tmp, res, threads); // D_out A D_in A' D_out x
+      scaledMult(out, unit, d_in, x, tmp, threads); // A D_in x
+      scaledMult(in, d_in, d_out, tmp, tmp2, threads); // D_in A' D_out A D_in x
+      res += tmp2;
+    }
+  }
+
+private:
+  const bool directed;
+  const int threads;
+  const Adjacency out, in;
+  arma::vec d_out, d_in, unit;
+};
+
+/**
+ EXPORTED FUNCTIONS
+ */
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+Rcpp::List socioCSR(const arma::umat& d_id,
+                    const arma::vec& y,
+                    int n_node,
+                    bool directed,
+                    bool impute = true)
+{
+  const arma::uword N_NODE = n_node;
+  arma::uvec from = d_id.col(0), to = d_id.col(1);
+  if(!directed){
+    from = arma::join_cols(d_id.col(0), d_id.col(1));
+    to = arma::join_cols(d_id.col(1), d_id.col(0));
+  }
+  // Cells with missing y count as unobserved
+  arma::vec y_cell = directed ? y : arma::vec(arma::join_cols(y, y));
+  const arma::uvec is_obs = arma::find_finite(y_cell);
+  from = from.elem(is_obs);
+  to = to.elem(is_obs);
+  y_cell = y_cell.elem(is_obs);
+  const arma::uvec is_edge = arma::find(y_cell == 1.0),
+    obs_from = from.elem(is_edge), obs_to = to.elem(is_edge);
+  std::vector<arma::uword> edge_from(obs_from.begin(), obs_from.end()),
+    edge_to(obs_to.begin(), obs_to.end());
+
+  // Unobserved cells are edges with the observed density
+  // (0.01 when nothing is observed). Cells are visited by
+  // geometric jumps, so time is linear in imputed edges.
+  if(impute){
+    const Adjacency observed(N_NODE, from, to), observed_edges(N_NODE, obs_from, obs_to);
+    const double obs_prop = observed.ind.n_elem > 0
+      ? double(observed_edges.ind.n_elem) / observed.ind.n_elem : 0.01;
+    for(arma::uword i = 0; (obs_prop > 0.0) && (i < N_NODE); ++i){
+      // Candidate columns are j != i (j > i if undirected) not observed
+      arma::uword o = observed.ptr[i], o_end = observed.ptr[i + 1];
+      double j = directed ? 0.0 : i + 1.0, target;
+      bool skip_diag = directed;
+      while((o < o_end) && (observed.ind[o] < j)){
+        ++o;
+      }
+      while(true){
+        target = j + R::rgeom(obs_prop);
+        bool moved = true;
+        while(moved){
+          moved = false;
+          if((o < o_end) && (observed.ind[o] <= target)){
+            ++target;
+            ++o;
+            moved = true;
+          } else if(skip_diag && (i <= target)){
+            ++target;
+            skip_diag = false;
+            moved = true;
+          }
+        }
+        if(target >= N_NODE){
+          break;
+        }
+        edge_from.push_back(i);
+        edge_to.push_back(target);
+        if(!directed){
+          edge_from.push_back(target);
+          edge_to.push_back(i);
+        }
+        j = target + 1.0;
+      }
+    }
+  }
+
+  const Adjacency soc(N_NODE, arma::uvec(edge_from), arma::uvec(edge_to));
+  return Rcpp::List::create(Rcpp::Named("ptr") = Rcpp::IntegerVector(soc.ptr.begin(), soc.ptr.end()),
+                            Rcpp::Named("ind") = Rcpp::IntegerVector(soc.ind.begin(), soc.ind.end()));
+}
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+Rcpp::List spectralEmbed(int n_node,
+                         const arma::umat& edges,
+                         bool directed,
+                         int n_elem,
+                         int iter = 20,
+                         int threads = 1)
+{
+  const arma::uword N_NODE = n_node,
+    N_ELEM = std::min(arma::uword(n_elem), N_NODE),
+    N_BASIS = std::min(N_ELEM + 10, N_NODE);
+  Laplacian U(N_NODE, edges, directed, threads);
+
+  // Randomized subspace iteration (Halko et al., 2011): the
+  // basis converges to the eigenvectors of largest magnitude.
+  arma::mat basis, R, U_basis = arma::randn<arma::mat>(N_NODE, N_BASIS);
+  arma::qr_econ(basis, R, U_basis);
+  for(int it = 0; it < iter; ++it){
+    U.mult(basis, U_basis);
+    arma::qr_econ(basis, R, U_basis);
+  }
+
+  // Rayleigh-Ritz step on the final basis
+  U.mult(basis, U_basis);
+  arma::mat small = basis.t() * U_basis, small_vec;
+  arma::vec small_val;
+  arma::eig_sym(small_val, small_vec, arma::symmatu(0.5 * (small + small.t())));
+  arma::uvec sel = arma::sort_index(arma::abs(small_val), "descend");
+  sel = sel.head(N_ELEM);
+  arma::vec values = small_val.elem(sel);
+  arma::mat vectors = basis * small_vec.cols(sel);
+
+  return Rcpp::List::create(Rcpp::Named("values") = Rcpp::NumericVector(values.begin(), values.end()),
+                            Rcpp::Named("vectors") = vectors);
+}
+
+//' @rdname auxfuns
+// [[Rcpp::export()]]
+Rcpp::IntegerVector kmeansPP(const arma::mat& x,
+                             int centers,
+                             int iter_max = 15,
+                             int nstart = 10,
+                             int threads = 1)
+{
+  const arma::uword N_POINT = x.n_rows, N_CLUST = centers;
+  if(N_CLUST < 1 || N_CLUST > N_POINT){
+    Rcpp::stop("Number of centers must be between 1 and the number of points.");
+  }
+  const arma::mat pts = x.t();
+  arma::uvec best_clust(N_POINT), clust(N_POINT);
+  arma::vec dist(N_POINT);
+  double best_ss = arma::datum::inf;
+
+  for(int s = 0; s < nstart; ++s){
+    // k-means++ seeding, drawn with R's RNG
+    arma::mat cents(pts.n_rows, N_CLUST);
+    cents.col(0) = pts.col(std::floor(R::unif_rand() * N_POINT));
+    for(arma::uword i = 0; i < N_POINT; ++i){
+      dist[i] = arma::accu(arma::square(pts.col(i) - cents.col(0)));
+    }
+    for(arma::uword c = 1; c < N_CLUST; ++c){
+      double tot = arma::accu(dist), u = R::unif_rand() * tot, acc = 0.0;
+      arma::uword pick = 0;
+      if(tot > 0.0){
+        while((pick < N_POINT - 1) && ((acc += dist[pick]) < u)){
+          ++pick;
+        }
+      } else {
+        pick = std::floor(R::unif_rand() * N_POINT);
+      }
+      cents.col(c) = pts.col(pick);
+      for(arma::uword i = 0; i < N_POINT; ++i){
+        dist[i] = std::min(dist[i], arma::accu(arma::square(pts.col(i) - cents.col(c))));
+      }
+    }
+
+    // Lloyd iterations
+    clust.fill(N_CLUST);
+    for(int it = 0; it < iter_max; ++it){
+      arma::uword changed = 0;
+#pragma omp parallel for schedule(static) reduction(+:changed) num_threads(threads) if(threads > 1)
+      for(arma::uword i = 0; i < N_POINT; ++i){
+        arma::uword best = 0;
+        double best_d = arma::datum::inf, d;
+        for(arma::uword c = 0; c < N_CLUST; ++c){
+          d = arma::accu(arma::square(pts.col(i) - cents.col(c)));
+          if(d < best_d){
+            best_d = d;
+            best = c;
+          }
+        }
+        dist[i] = best_d;
+        if(best != clust[i]){
+          clust[i] = best;
+          changed++;
+        }
+      }
+      if(changed == 0){
+        break;
+      }
+      // Empty clusters keep their previous center
+      arma::mat sums(pts.n_rows, N_CLUST, arma::fill::zeros);
+      arma::vec counts(N_CLUST, arma::fill::zeros);
+      for(arma::uword i = 0; i < N_POINT; ++i){
+        sums.col(clust[i]) += pts.col(i);
+        counts[clust[i]]++;
+      }
+      for(arma::uword c = 0; c < N_CLUST; ++c){
+        if(counts[c] > 0){
+          cents.col(c) = sums.col(c) / counts[c];
+        }
+      }
+    }
+
+    double ss = arma::accu(dist);
+    if(ss < best_ss){
+      best_ss = ss;
+      best_clust = clust;
+    }
+  }
+
+  Rcpp::IntegerVector res(N_POINT);
+  for(arma::uword i = 0; i < N_POINT; ++i){
+    res[i] = best_clust[i] + 1;
+  }
+  return res;
+}
@@ -0,0 +1,273 @@
+//' @name mmsbm_benchmark
+//' @title Benchmark of the C++ Fitter on a Synthetic Network
+//'
+//' @description Simulates a dynamic mixed-membership stochastic blockmodel of the
+//' requested size and times each step of the variational EM algorithm
+//' used by \code{\link{mmsbm}}, for each requested number of threads.
+//'
+//' @param n_nodes Integer; number of nodes in each time period.
+//' @param n_blocks Integer; number of latent groups.
+//' @param n_states Integer; number of hidden Markov states.
+//' @param n_periods Integer; number of time periods.
+//' @param n_monad_pred Integer; number of monadic predictors (excluding the intercept).
+//' @param n_dyad_pred Integer; number of dyadic predictors.
+//' @param dyads_per_node Integer; number of dyads sent by each node in each period.
+//' @param density Numeric; probability of an edge between nodes in different groups.
+//'                Edges within groups are more likely.
+//' @param threads Integer vector; numbers of threads to benchmark.
+//' @param iter Integer; number of iterations timed for each number of threads.
+//' @param batch_size Numeric; proportion of nodes sampled in each local step.
+//'                   Values of 1.0 or more disable stochastic VI.
+//' @param directed Boolean; is the network directed?
+//'
+//' @return A \code{data.frame} with one row per number of threads and step
+//'         (\code{setup}, \code{sampleDyads}, \code{updatePhi}, \code{updateKappa},
+//'         \code{optimAlpha}, \code{optimTheta} and \code{LB}), containing the mean
+//'         time per iteration in seconds (total time for \code{setup}), the mean number of dyads visited, the
+//'         resulting throughput in dyads per second (\code{NA} for node-level steps),
+//'         and the peak resident memory of the process in megabytes (\code{NA} when
+//'         not available on the platform).
+//'
+//' @section Warning:
+//'          The network is drawn with R's random number generator; call \code{set.seed}
+//'          beforehand for reproducible benchmarks. Peak memory includes the R session.
+//'
+//' @author Santiago Olivella (olivella@@unc.edu), Adeline Lo (adelinel@@princeton.edu), Tyler Pratt (tyler.pratt@@yale.edu), Kosuke Imai (imai@@harvard.edu)
+
+
+
+#include <fstream>
+#include <string>
+#include "MMModelClass.h"
+
+// Peak resident memory (in MB) since the last reset,
+// read from the process status file on Linux.
+double peakMemory()
+{
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while(std::getline(status, line)){
+    if(line.compare(0, 6, "VmHWM:") == 0){
+      return std::stod(line.substr(6)) / 1024.0;
+    }
+  }
+#endif
+  return NA_REAL;
+}
+
+void resetPeakMemory()
+{
+#ifdef __linux__
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+#endif
+}
+
+// Draw a group from a mixed-membership vector
+arma::uword sampleBlock(const arma::mat& pi_mat, arma::uword p)
+{
+  double u = R::unif_rand(), cs = pi_mat(0, p);
+  arma::uword g = 0;
+  while((cs < u) && (g < pi_mat.n_rows - 1)){
+    cs += pi_mat(++g, p);
+  }
+  return g;
+}
+
+// [[Rcpp::export(mmsbm_benchmark)]]
+Rcpp::DataFrame mmsbm_benchmark(int n_nodes,
+                                int n_blocks,
+                                int n_states,
+                                int n_periods,
+                                int n_monad_pred,
+                                int n_dyad_pred,
+                                int dyads_per_node,
+                                double density,
+                                Rcpp::IntegerVector threads,
+                                int iter = 10,
+                                double batch_size = 0.05,
+                                bool directed = true)
+{
+  if(n_nodes < 2 || n_blocks < 1 || n_states < 1 || n_periods < 1 || dyads_per_node < 1 || iter < 1){
+    Rcpp::stop("Invalid network dimensions.");
+  }
+  const arma::uword N_NODE = arma::uword(n_nodes) * n_periods,
+    N_DYAD = N_NODE * dyads_per_node,
+    N_BLK = n_blocks,
+    N_STATE = n_states,
+    N_MONAD_PRED = n_monad_pred + 1,
+    N_DYAD_PRED = n_dyad_pred > 0 ? n_dyad_pred : 1;
+  const bool svi = batch_size < 1.0;
+
+  /**
+   SYNTHETIC NETWORK
+   */
+
+  arma::uvec time_id_node(N_NODE), time_id_dyad(N_DYAD),
+    nodes_per_period(n_periods), n_batch(n_periods);
+  arma::field<arma::uvec> node_id_period(n_periods);
+  for(int t = 0; t < n_periods; ++t){
+    nodes_per_period[t] = n_nodes;
+    n_batch[t] = svi ? std::max(1.0, std::floor(batch_size * n_nodes)) : n_nodes;
+    arma::uword first = arma::uword(t) * n_nodes, last = first + n_nodes - 1;
+    node_id_period(t) = arma::regspace<arma::uvec>(first, last);
+    time_id_node.subvec(first, last).fill(t);
+  }
+
+  // Monadic predictors (with intercept) and mixed-memberships
+  arma::mat x_t(N_MONAD_PRED, N_NODE), pi_mat(N_BLK, N_NODE);
+  for(arma::uword p = 0; p < N_NODE; ++p){
+    x_t(0, p) = 1.0;
+    for(arma::uword x = 1; x < N_MONAD_PRED; ++x){
+      x_t(x, p) = R::rnorm(0.0, 1.0);
+    }
+    for(arma::uword g = 0; g < N_BLK; ++g){
+      pi_mat(g, p) = R::rgamma(0.5, 1.0);
+    }
+    pi_mat.col(p) /= arma::accu(pi_mat.col(p));
+  }
+
+  // Dyads, dyadic predictors and edges
+  arma::umat node_id_dyad(N_DYAD, 2);
+  arma::mat z_t(N_DYAD_PRED, N_DYAD, arma::fill::zeros);
+  arma::vec y(N_DYAD);
+  double base = R::qlogis(density, 0.0, 1.0, 1, 0);
+  arma::uword d = 0, p, q, g, h;
+  for(arma::uword i = 0; i < N_NODE; ++i){
+    arma::uword t = time_id_node[i];
+    for(int j = 0; j < dyads_per_node; ++j, ++d){
+      p = i;
+      q = t * n_nodes + std::floor(R::unif_rand() * (n_nodes - 1));
+      if(q >= p){
+        ++q;
+      }
+      node_id_dyad(d, 0) = p;
+      node_id_dyad(d, 1) = q;
+      time_id_dyad[d] = t;
+      double linpred = 0.0;
+      for(int z = 0; z < n_dyad_pred; ++z){
+        z_t(z, d) = R::rnorm(0.0, 1.0);
+        linpred += 0.5 * z_t(z, d);
+      }
+      g = sampleBlock(pi_mat, p);
+      h = sampleBlock(pi_mat, q);
+      linpred += base + (g == h ? 3.0 : 0.0);
+      y[d] = R::unif_rand() < R::plogis(linpred, 0.0, 1.0, 1, 0) ? 1.0 : 0.0;
+    }
+  }
+
+  // Priors and initial values
+  arma::mat mu_b(N_BLK, N_BLK), var_b(N_BLK, N_BLK, arma::fill::ones);
+  mu_b.fill(-5.0);
+  mu_b.diag().fill(5.0);
+  var_b *= 5.0;
+  arma::cube mu_beta(N_MONAD_PRED, N_BLK, N_STATE, arma::fill::zeros),
+    var_beta(N_MONAD_PRED, N_BLK, N_STATE, arma::fill::ones);
+  var_beta *= 5.0;
+  arma::vec mu_gamma(n_dyad_pred > 0 ? n_dyad_pred : 0, arma::fill::zeros),
+    var_gamma(n_dyad_pred > 0 ? n_dyad_pred : 0, arma::fill::ones);
+  var_gamma *= 5.0;
+
+  Rcpp::List control;
+  control["blocks"] = n_blocks;
+  control["states"] = n_states;
+  control["times"] = n_periods;
+  control["directed"] = directed;
+  control["opt_iter"] = 10e3;
+  control["batch_size"] = Rcpp::wrap(n_batch);
+  control["lbfgs"] = false;
+  control["lbfgs_mem"] = 10;
+  control["eta"] = n_states > 1 ? double(n_periods) / n_states : 1.0;
+  control["forget_rate"] = svi ? 0.75 : 0.0;
+  control["delay"] = 1.0;
+  control["verbose"] = false;
+  control["reorder_dyads"] = true;
+  control["node_est"] = Rcpp::wrap(arma::uvec(N_NODE, arma::fill::ones));
+  control["fixed_times"] = Rcpp::IntegerVector(0);
+  control["ooc_dir"] = "";
+  control["svi"] = svi;
+
+  /**
+   TIMINGS
+   */
+
+  const int N_PHASE = 7;
+  const char* phases[N_PHASE] = {"setup", "sampleDyads", "updatePhi", "updateKappa",
+                                 "optimAlpha", "optimTheta", "LB"};
+  const arma::uword n_rows = N_PHASE * threads.size();
+  Rcpp::IntegerVector res_threads(n_rows);
+  Rcpp::CharacterVector res_phase(n_rows);
+  Rcpp::NumericVector res_sec(n_rows), res_dyads(n_rows), res_tput(n_rows), res_mem(n_rows);
+
+  for(int th = 0; th < threads.size(); ++th){
+    control["threads"] = threads[th];
+    arma::mat kappa_init_t(N_STATE, n_periods);
+    kappa_init_t.fill(1.0 / N_STATE);
+    arma::mat b_init_t = mu_b;
+    arma::cube beta_init = mu_beta;
+    arma::vec gamma_init(N_DYAD_PRED, arma::fill::zeros);
+
+    resetPeakMemory();
+    arma::vec sec(N_PHASE, arma::fill::zeros), dyads(N_PHASE, arma::fill::zeros);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    MMModel Model(z_t, x_t, y, time_id_dyad, time_id_node, nodes_per_period,
+                  node_id_dyad, node_id_period, mu_b, var_b, mu_beta, var_beta,
+                  mu_gamma, var_gamma, pi_mat, kappa_init_t, b_init_t,
+                  beta_init, gamma_init, control);
+    sec[0] = elapsed(start);
+    dyads[0] = N_DYAD;
+
+    for(int i = 0; i < iter; ++i){
+      Rcpp::checkUserInterrupt();
+      if(svi){
+        start = std::chrono::steady_clock::now();
+        Model.sampleDyads(i);
+        sec[1] += elapsed(start);
+        dyads[1] += Model.getNDyadBatch();
+      }
+      double n_dyad_batch = Model.getNDyadBatch();
+      dyads[2] += n_dyad_batch;
+      dyads[5] += n_dyad_batch;
+      dyads[6] += N_DYAD;
+      start = std::chrono::steady_clock::now();
+      Model.updatePhi();
+      sec[2] += elapsed(start);
+      if(N_STATE > 1){
+        start = std::chrono::steady_clock::now();
+        Model.updateKappa();
+        sec[3] += elapsed(start);
+      }
+      start = std::chrono::steady_clock::now();
+      Model.optim_ours(true);
+      sec[4] += elapsed(start);
+      start = std::chrono::steady_clock::now();
+      Model.optim_ours(false);
+      sec[5] += elapsed(start);
+      start = std::chrono::steady_clock::now();
+      Model.LB();
+      sec[6] += elapsed(start);
+    }
+
+    double mem = peakMemory();
+    for(int k = 0; k < N_PHASE; ++k){
+      arma::uword row = th * N_PHASE + k;
+      res_threads[row] = threads[th];
+      res_phase[row] = phases[k];
+      double n_rep = (k == 0) ? 1.0 : iter; //setup runs once
+      bool node_level = (k == 3) || (k == 4);
+      res_sec[row] = sec[k] / n_rep;
+      res_dyads[row] = node_level ? NA_REAL : dyads[k] / n_rep;
+      res_tput[row] = (node_level || sec[k] == 0.0) ? NA_REAL : dyads[k] / sec[k];
+      res_mem[row] = mem;
+    }
+  }
+
+  return Rcpp::DataFrame::create(Rcpp::Named("threads") = res_threads,
+                                 Rcpp::Named("phase") = res_phase,
+                                 Rcpp::Named("seconds") = res_sec,
+                                 Rcpp::Named("dyads") = res_dyads,
+                                 Rcpp::Named("dyads_per_sec") = res_tput,
+                                 Rcpp::Named("peak_mem_mb") = res_mem,
+                                 Rcpp::Named("stringsAsFactors") = false);
+}
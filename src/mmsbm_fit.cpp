@@ -18,9 +18,16 @@
 //' @param b_init_t Numeric matrix; square matrix of initial values of blockmodel.
 //' @param beta_init Numeric vector; flat array (column-major order) of initial values of monadic coefficients.
 //' @param gamma_init Numeric vector; vector of initial values of dyadic coefficients
-//' @param control List; see the \code{mmsbm.control} argument of \code{\link{mmsbm}}
+//' @param control List; see the \code{mmsbm.control} argument of \code{\link{mmsbm}}. If \code{control$resume}
+//'                is \code{TRUE} and \code{control$checkpoint} exists, estimation continues from the saved state.
 //' 
 //' @return Unclassed list with named components; see \code{Value} of \code{\link{mmsbm}}
+//' @details \code{x_t} is read in place rather than copied. When \code{control$reorder_dyads} is \code{TRUE},
+//'          \code{y}, \code{z_t} and the node and period identifiers of each dyad are copied once into the internal
+//'          dyad order, so that estimation reads them sequentially; otherwise \code{y} and \code{z_t} are read
+//'          in place. When \code{control$ooc_dir} is not empty, the variational
+//'          parameters and the sorted copy of \code{z_t} are held in file-backed buffers; \code{SenderPhi} and
+//'          \code{ReceiverPhi} are still allocated in memory when they are returned.
 //' @section Warning:
 //'          This function is for internal use only. End-users should always resort to \code{\link{mmsbm}}.
 //'          In particular, that interface post-processes the return value of this internal in important ways. 
@@ -29,8 +36,81 @@
 
 
 
+#include <fstream>
+#include <cstdio>
 #include "MMModelClass.h"
 
+// Checkpoints hold the iteration count, the LB trace and
+// the iterations it was evaluated at, R's RNG state and the variational state of the model.
+static const char CKPT_MAGIC[8] = {'N','M','X','C','K','P','T','2'};
+
+void saveCheckpoint(const std::string& path, MMModel& Model,
+                    arma::uword iter, const std::vector<double>& ll_vec,
+                    const std::vector<int>& ll_iter)
+{
+  PutRNGstate();
+  Rcpp::IntegerVector seed = Rcpp::Environment::global_env()[".Random.seed"];
+  std::string tmp_path = path + ".tmp";
+  std::ofstream out(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+  if(!out){
+    Rcpp::stop("Cannot open checkpoint file for writing.");
+  }
+  unsigned long long iter_out = iter;
+  out.write(CKPT_MAGIC, sizeof(CKPT_MAGIC));
+  out.write(reinterpret_cast<const char*>(&iter_out), sizeof(iter_out));
+  writeBlock(out, ll_vec.data(), ll_vec.size());
+  writeBlock(out, ll_iter.data(), ll_iter.size());
+  writeBlock(out, seed.begin(), seed.size());
+  Model.saveState(out);
+  out.close();
+  if(!out){
+    Rcpp::stop("Failed to write checkpoint file.");
+  }
+  // Replace previous checkpoint only once the new one is complete
+  std::remove(path.c_str());
+  if(std::rename(tmp_path.c_str(), path.c_str()) != 0){
+    Rcpp::stop("Failed to write checkpoint file.");
+  }
+}
+
+bool loadCheckpoint(const std::string& path, MMModel& Model,
+                    arma::uword& iter, std::vector<double>& ll_vec,
+                    std::vector<int>& ll_iter)
+{
+  std::ifstream in(path.c_str(), std::ios::binary);
+  if(!in){
+    return false;
+  }
+  char magic[sizeof(CKPT_MAGIC)];
+  unsigned long long iter_in = 0, n = 0;
+  in.read(magic, sizeof(magic));
+  if(!in || !std::equal(magic, magic + sizeof(magic), CKPT_MAGIC)){
+    Rcpp::stop("File is not a valid checkpoint.");
+  }
+  in.read(reinterpret_cast<char*>(&iter_in), sizeof(iter_in));
+  iter = iter_in;
+  
+  // Variable-length blocks: peek at the element count first
+  std::streampos pos = in.tellg();
+  in.read(reinterpret_cast<char*>(&n), sizeof(n));
+  in.seekg(pos);
+  ll_vec.resize(n);
+  readBlock(in, ll_vec.data(), n);
+  ll_iter.resize(n);
+  readBlock(in, ll_iter.data(), n);
+  pos = in.tellg();
+  in.read(reinterpret_cast<char*>(&n), sizeof(n));
+  in.seekg(pos);
+  Rcpp::IntegerVector seed(n);
+  readBlock(in, seed.begin(), n);
+  
+  Model.loadState(in);
+  
+  Rcpp::Environment::global_env().assign(".Random.seed", seed);
+  GetRNGstate();
+  return true;
+}
+
 
 
 // [[Rcpp::export(mmsbm_fit)]]
@@ -87,6 +167,7 @@ Rcpp::List mmsbm_fit(const arma::mat& z_t,
     //nworse = 0,
     //win_size = control["conv_window"],
     VI_ITER = control["vi_iter"],
+    LB_FREQ = control["lb_freq"],
     N_BLK = control["blocks"],
     N_STATE = control["states"];
   
@@ -97,78 +178,137 @@ Rcpp::List mmsbm_fit(const arma::mat& z_t,
   double tol = Rcpp::as<double>(control["conv_tol"]),
      newLL, oldLL;
   
-  oldLL = Model.LB();
-  newLL = 0.0;
+  std::string ckpt_path = Rcpp::as<std::string>(control["checkpoint"]);
+  arma::uword CKPT_EVERY = ckpt_path.empty() ? 0 : Rcpp::as<int>(control["checkpoint_every"]);
+  std::vector<double> ll_vec;
+  std::vector<int> ll_iter;
+  if(Rcpp::as<bool>(control["resume"]) && !ckpt_path.empty()){
+    if(loadCheckpoint(ckpt_path, Model, iter, ll_vec, ll_iter) && verbose){
+      Rprintf("Resuming from iteration %i.\n", (int)iter);
+    }
+  }
+  
+  // Starting bound is only needed to trace every iteration
+  if(LB_FREQ == 1){
+    oldLL = Model.LB();
+  }
+  newLL = ll_vec.empty() ? 0.0 : ll_vec.back();
   //arma::vec running_ll(win_size, arma::fill::zeros);
   arma::cube beta_new, beta_old; 
   arma::mat b_old, b_new;
   arma::vec gamma_new, gamma_old;
-  std::vector<double> ll_vec;
   
   beta_old = Model.getBeta();
   b_old = Model.getB();
   gamma_old = Model.getGamma();
+  
+  // Per-iteration profile: wall time of each step (NA if
+  // skipped), optimizer counts, step size and batch size
+  std::vector<double> prof_sample, prof_phi, prof_kappa, prof_alpha, prof_theta, prof_lb,
+    prof_step, prof_batch, prof_fallback;
+  std::vector<int> prof_iter, prof_fn_alpha, prof_gr_alpha, prof_fail_alpha,
+    prof_fn_theta, prof_gr_theta, prof_fail_theta;
+  std::chrono::steady_clock::time_point start;
+  arma::ivec optim_counts;
+  
   while(iter < VI_ITER && conv == false){
     Rcpp::checkUserInterrupt();
+    prof_iter.push_back(iter + 1);
+    // Sample batch of dyads for stochastic
+    // local (E) and global (M) steps
+    start = std::chrono::steady_clock::now();
+    if(svi){
+    Model.sampleDyads(iter);
+    }
+    prof_sample.push_back(svi ? elapsed(start) : NA_REAL);
+    prof_step.push_back(Model.getStepSize());
+    prof_batch.push_back(Model.getNDyadBatch());
     // E-STEP
+    start = std::chrono::steady_clock::now();
     Model.updatePhi();
+    prof_phi.push_back(elapsed(start));
+    prof_fallback.push_back(Model.getPhiFallbacks());
     
+    start = std::chrono::steady_clock::now();
     if(N_STATE > 1){
       Model.updateKappa();
     }
+    prof_kappa.push_back(N_STATE > 1 ? elapsed(start) : NA_REAL);
     // 
     // 
     // //M-STEP
-    // Sample batch of dyads for stochastic optim
-    if(svi){
-    Model.sampleDyads(iter);
-    }
+    start = std::chrono::steady_clock::now();
     Model.optim_ours(true); //optimize alphaLB
+    prof_alpha.push_back(elapsed(start));
+    optim_counts = Model.getOptimCounts(true);
+    prof_fn_alpha.push_back(optim_counts[0]);
+    prof_gr_alpha.push_back(optim_counts[1]);
+    prof_fail_alpha.push_back(optim_counts[2]);
+    
+    start = std::chrono::steady_clock::now();
     Model.optim_ours(false); //optimize thetaLB
+    prof_theta.push_back(elapsed(start));
+    optim_counts = Model.getOptimCounts(false);
+    prof_fn_theta.push_back(optim_counts[0]);
+    prof_gr_theta.push_back(optim_counts[1]);
+    prof_fail_theta.push_back(optim_counts[2]);
     //
     //Check convergence
     
 
-    // if(svi){
-    newLL = Model.LB();
     beta_new = Model.getBeta();
     b_new = Model.getB();
     gamma_new = Model.getGamma();
     Model.convCheck(conv, beta_new, beta_old, b_new, b_old, gamma_new, gamma_old, tol);
-    //   std::rotate(running_ll.begin(), running_ll.begin() + 1, running_ll.end());
-    //   running_ll[win_size - 1] = newLL;
-    //   if(iter > win_size) {
-    //     Model.convCheck(conv, running_ll, tol);
-    //   }
-    // } else {
-    //   newLL = Model.LB();
-    //   //Rprintf("New %f, old %f\n", newLL, oldLL);
-    //   conv = (fabs((newLL-oldLL)/oldLL) < tol);
-    // }
+    beta_old = beta_new;
+    b_old = b_new;
+    gamma_old = gamma_new;
+    
+    // Full lower bound is only used for monitoring; evaluate it
+    // every LB_FREQ iterations and at the last one.
+    prof_lb.push_back(NA_REAL);
+    if(((iter + 1) % LB_FREQ == 0) || conv || (iter + 1 == VI_ITER)){
+      start = std::chrono::steady_clock::now();
+      newLL = Model.LB();
+      prof_lb.back() = elapsed(start);
       ll_vec.push_back(newLL);
-      beta_old = beta_new;
-      b_old = b_new;
-      gamma_old = gamma_new;
+      ll_iter.push_back(iter + 1);
       oldLL = newLL;
-    
-    if(verbose){
-      if((iter+1) % 1 == 0) {
+      if(verbose){
         Rprintf("Iter: %i, LB: %f\r", iter + 1, newLL);
       }
     }
     ++iter;
+    if(CKPT_EVERY && (iter % CKPT_EVERY == 0)){
+      saveCheckpoint(ckpt_path, Model, iter, ll_vec, ll_iter);
+    }
+  }
+  if(CKPT_EVERY && (iter % CKPT_EVERY != 0)){
+    saveCheckpoint(ckpt_path, Model, iter, ll_vec, ll_iter);
   }
   if(verbose){
       Rprintf("Final LB: %f.                     \n", iter+1, newLL);
   }
   
-  ll_vec.erase(ll_vec.begin());
+  // Drop the first bound only when tracing every iteration
+  if((LB_FREQ == 1) && (ll_vec.size() > 1)){
+    ll_vec.erase(ll_vec.begin());
+    ll_iter.erase(ll_iter.begin());
+  }
   
   //Form return objects
-  arma::mat C_res = Model.getC();
-  arma::mat postmm_res = Model.getPostMM();
-  arma::mat send_phi = Model.getPhi(true);
-  arma::mat rec_phi = Model.getPhi(false);
+  // Large outputs are written straight into R-owned memory
+  arma::uword N_NODE = x_t.n_cols, N_DYAD = y.n_elem;
+  Rcpp::NumericMatrix C_res(N_NODE, N_BLK), postmm_res(N_BLK, N_NODE),
+    send_phi(N_BLK, N_DYAD), rec_phi(N_BLK, N_DYAD);
+  arma::mat C_view(C_res.begin(), N_NODE, N_BLK, false, true),
+    postmm_view(postmm_res.begin(), N_BLK, N_NODE, false, true),
+    send_phi_view(send_phi.begin(), N_BLK, N_DYAD, false, true),
+    rec_phi_view(rec_phi.begin(), N_BLK, N_DYAD, false, true);
+  Model.getC(C_view);
+  Model.getPostMM(postmm_view);
+  Model.getPhi(true, send_phi_view);
+  Model.getPhi(false, rec_phi_view);
   arma::uvec tot_nodes = Model.getN();
   arma::mat A = Model.getWmn();
   arma::mat kappa_res = Model.getKappa();
@@ -194,6 +334,23 @@ Rcpp::List mmsbm_fit(const arma::mat& z_t,
   res["niter"] = iter + 1;
   res["converged"] = conv;
   res["LowerBound_full"] = Rcpp::wrap(ll_vec);
+  res["LowerBound_iter"] = Rcpp::wrap(ll_iter);
+  res["Profile"] = Rcpp::DataFrame::create(Rcpp::Named("iter") = prof_iter,
+                                           Rcpp::Named("time_sample") = prof_sample,
+                                           Rcpp::Named("time_phi") = prof_phi,
+                                           Rcpp::Named("time_kappa") = prof_kappa,
+                                           Rcpp::Named("time_alpha") = prof_alpha,
+                                           Rcpp::Named("time_theta") = prof_theta,
+                                           Rcpp::Named("time_lb") = prof_lb,
+                                           Rcpp::Named("fncount_alpha") = prof_fn_alpha,
+                                           Rcpp::Named("grcount_alpha") = prof_gr_alpha,
+                                           Rcpp::Named("fail_alpha") = prof_fail_alpha,
+                                           Rcpp::Named("fncount_theta") = prof_fn_theta,
+                                           Rcpp::Named("grcount_theta") = prof_gr_theta,
+                                           Rcpp::Named("fail_theta") = prof_fail_theta,
+                                           Rcpp::Named("step_size") = prof_step,
+                                           Rcpp::Named("batch_dyads") = prof_batch,
+                                           Rcpp::Named("phi_fallbacks") = prof_fallback);
   
   
   return res;